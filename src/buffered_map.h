@@ -0,0 +1,247 @@
+#ifndef MAP_BUFFERED_MAP_H
+#define MAP_BUFFERED_MAP_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "map.h"
+
+// Map for write bursts followed by read phases. Insert, InsertOrAssign and Erase only append to a contiguous delta
+// buffer, the buffered writes are applied to the underlying Map in key order once the buffer reaches its flush
+// threshold or on Flush(). Point lookups consult the delta and then the map without flushing, everything that needs
+// the elements in key order (iteration, LowerBound, Range, Scan, Size) flushes first.
+template <class KeyType, class ValueType> class BufferedMap
+{
+  public:
+    using value_type = typename Map<KeyType, ValueType>::value_type;
+    using iterator = typename Map<KeyType, ValueType>::iterator;
+    using range_cursor = typename Map<KeyType, ValueType>::range_cursor;
+
+    static constexpr std::size_t kDefaultFlushThreshold = 1024;
+
+  public:
+    BufferedMap() = default;
+    explicit BufferedMap(std::size_t flush_threshold) : flush_threshold_(flush_threshold)
+    {
+        assert(flush_threshold_ > 0);
+    }
+
+    // Inserts "element" at the next flush unless its key is present by then
+    void Insert(value_type element)
+    {
+        append(std::move(element.first), Operation::INSERT, std::move(element.second));
+    }
+    void InsertOrAssign(KeyType key, ValueType value)
+    {
+        append(std::move(key), Operation::ASSIGN, std::move(value));
+    }
+    void Erase(KeyType key)
+    {
+        append(std::move(key), Operation::ERASE, std::nullopt);
+    }
+
+    // Returns the value "key" maps to once the buffered writes are applied, or nullptr if it will be absent. The
+    // pointer stays valid until the next write or flush.
+    ValueType* Get(const KeyType& key)
+    {
+        sortDelta();
+        const auto first = std::lower_bound(delta_.begin(), delta_.end(), key,
+                                            [](const Write& write, const KeyType& k) { return write.key < k; });
+        const auto last = std::upper_bound(first, delta_.end(), key,
+                                           [](const KeyType& k, const Write& write) { return k < write.key; });
+        const auto [state, write] = resolve(first, last);
+        if (state == State::ABSENT)
+        {
+            return nullptr;
+        }
+        if (state != State::BUFFERED)
+        {
+            auto element = map_.Find(key);
+            if (element != map_.end())
+            {
+                return &element->second;
+            }
+            if (state == State::MAP)
+            {
+                return nullptr;
+            }
+        }
+        return &*write->value;
+    }
+    [[nodiscard]] bool Contains(const KeyType& key)
+    {
+        return Get(key) != nullptr;
+    }
+
+    // Applies the buffered writes to the map. They are applied in key order, so consecutive writes descend along
+    // mostly the same, already cached, path.
+    void Flush()
+    {
+        sortDelta();
+        for (auto first = delta_.begin(); first != delta_.end();)
+        {
+            auto last = first + 1;
+            while (last != delta_.end() && !(first->key < last->key))
+            {
+                ++last;
+            }
+            const auto [state, write] = resolve(first, last);
+            switch (state)
+            {
+            case State::ABSENT: {
+                const auto element = map_.Find(first->key);
+                if (element != map_.end())
+                {
+                    map_.Erase(element);
+                }
+                break;
+            }
+            case State::BUFFERED:
+                map_.InsertOrAssign(std::move(write->key), std::move(*write->value));
+                break;
+            case State::MAP_OR_BUFFERED:
+                map_.TryEmplace(std::move(write->key), std::move(*write->value));
+                break;
+            case State::MAP:
+                break;
+            }
+            first = last;
+        }
+        delta_.clear();
+        sorted_count_ = 0;
+    }
+
+    // Number of writes waiting for the next flush
+    [[nodiscard]] std::size_t BufferedCount() const
+    {
+        return delta_.size();
+    }
+
+    // The underlying map with every buffered write applied, for the operations not wrapped here
+    Map<KeyType, ValueType>& Flushed()
+    {
+        Flush();
+        return map_;
+    }
+
+    [[nodiscard]] std::size_t Size()
+    {
+        return Flushed().Size();
+    }
+    [[nodiscard]] bool Empty()
+    {
+        return Flushed().Empty();
+    }
+    iterator LowerBound(const KeyType& key)
+    {
+        return Flushed().LowerBound(key);
+    }
+    range_cursor Range(const KeyType& lo, const KeyType& hi)
+    {
+        return Flushed().Range(lo, hi);
+    }
+    template <typename Visitor> std::size_t Scan(const KeyType& lo, const KeyType& hi, Visitor&& visitor)
+    {
+        return Flushed().Scan(lo, hi, std::forward<Visitor>(visitor));
+    }
+    iterator begin()
+    {
+        return Flushed().begin();
+    }
+    iterator end()
+    {
+        return map_.end();
+    }
+
+  private:
+    enum class Operation : std::uint8_t
+    {
+        INSERT,
+        ASSIGN,
+        ERASE
+    };
+    struct Write
+    {
+        KeyType key;
+        Operation operation;
+        std::optional<ValueType> value; // Empty for ERASE
+    };
+    using delta_iterator = typename std::vector<Write>::iterator;
+
+    // What the writes buffered for one key add up to
+    enum class State : std::uint8_t
+    {
+        MAP,             // Whatever the map holds
+        ABSENT,          // Erased
+        BUFFERED,        // The buffered value
+        MAP_OR_BUFFERED, // The map's value if it has the key, otherwise the buffered value
+    };
+
+    void append(KeyType&& key, Operation operation, std::optional<ValueType>&& value)
+    {
+        delta_.push_back({std::move(key), operation, std::move(value)});
+        if (delta_.size() >= flush_threshold_)
+        {
+            Flush();
+        }
+    }
+
+    // Sorts the writes by key, writes to the same key stay in the order they were made. Only the writes appended
+    // since the last sort are sorted, then merged with the rest.
+    void sortDelta()
+    {
+        if (sorted_count_ == delta_.size())
+        {
+            return;
+        }
+        const auto byKey = [](const Write& a, const Write& b) { return a.key < b.key; };
+        const auto sorted_end = delta_.begin() + static_cast<std::ptrdiff_t>(sorted_count_);
+        std::stable_sort(sorted_end, delta_.end(), byKey);
+        std::inplace_merge(delta_.begin(), sorted_end, delta_.end(), byKey);
+        sorted_count_ = delta_.size();
+    }
+
+    // Folds the writes to one key in [first, last), oldest first. Returns the resulting state and, unless it doesn't
+    // involve a buffered value, the write holding that value.
+    static std::pair<State, delta_iterator> resolve(delta_iterator first, delta_iterator last)
+    {
+        State state = State::MAP;
+        delta_iterator value_write = last;
+        for (auto write = first; write != last; ++write)
+        {
+            switch (write->operation)
+            {
+            case Operation::ERASE:
+                state = State::ABSENT;
+                value_write = last;
+                break;
+            case Operation::ASSIGN:
+                state = State::BUFFERED;
+                value_write = write;
+                break;
+            case Operation::INSERT:
+                if (state == State::MAP || state == State::ABSENT)
+                {
+                    state = state == State::MAP ? State::MAP_OR_BUFFERED : State::BUFFERED;
+                    value_write = write;
+                }
+                break;
+            }
+        }
+        return {state, value_write};
+    }
+
+  private:
+    Map<KeyType, ValueType> map_;
+    std::vector<Write> delta_;
+    // Length of the prefix of "delta_" known to be sorted
+    std::size_t sorted_count_ = 0;
+    std::size_t flush_threshold_ = kDefaultFlushThreshold;
+};
+
+#endif // MAP_BUFFERED_MAP_H
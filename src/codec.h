@@ -0,0 +1,219 @@
+#ifndef MAP_CODEC_H
+#define MAP_CODEC_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Describes how keys and values are laid out in the serialized map formats. Arithmetic and enum types are stored as
+// their object representation, other types need a specialization providing the same members.
+template <class T> struct Codec;
+
+// Whether values of T are stored as their object representation. Specialize it to true only for trivially copyable
+// types without padding bytes, which would make the encoding and its checksum indeterminate, and without pointers,
+// which mean nothing to the process reading the map.
+template <class T> inline constexpr bool kEncodeAsBytes = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+template <class T>
+    requires kEncodeAsBytes<T>
+struct Codec<T>
+{
+    static_assert(std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> && !std::is_member_pointer_v<T>,
+                  "only trivially copyable types without pointers can be stored as bytes");
+
+    // Every encoding has the same size, so elements can be addressed without an offset table
+    static constexpr bool kFixedSize = true;
+    static constexpr std::size_t kSize = sizeof(T);
+    // What lookups in a mapped file hand out, this points straight into the mapping
+    using view_type = const T&;
+
+    static std::size_t Size(const T&)
+    {
+        return kSize;
+    }
+    static void Encode(const T& value, std::byte* out)
+    {
+        std::memcpy(out, &value, kSize);
+    }
+    static view_type View(const std::byte* data, std::size_t)
+    {
+        return *reinterpret_cast<const T*>(data);
+    }
+    static T Decode(const std::byte* data, std::size_t)
+    {
+        T value;
+        std::memcpy(&value, data, kSize);
+        return value;
+    }
+};
+
+template <class T> struct Codec<T*>
+{
+    static_assert(!std::is_pointer_v<T*>, "pointers mean nothing to the process reading the serialized map");
+};
+
+template <> struct Codec<std::string>
+{
+    static constexpr bool kFixedSize = false;
+    using view_type = std::string_view;
+
+    static std::size_t Size(const std::string& value)
+    {
+        return value.size();
+    }
+    static void Encode(const std::string& value, std::byte* out)
+    {
+        // The buffer of an empty string may be null, which memcpy doesn't accept even for zero bytes
+        if (!value.empty())
+        {
+            std::memcpy(out, value.data(), value.size());
+        }
+    }
+    static view_type View(const std::byte* data, std::size_t size)
+    {
+        return {reinterpret_cast<const char*>(data), size};
+    }
+    static std::string Decode(const std::byte* data, std::size_t size)
+    {
+        return std::string(View(data, size));
+    }
+};
+
+// 64-bit FNV-1a, used to detect corrupted or truncated serialized maps
+class Checksum
+{
+  public:
+    void Update(const void* data, std::size_t size)
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            hash_ = (hash_ ^ bytes[i]) * 0x100000001b3ULL;
+        }
+    }
+    [[nodiscard]] std::uint64_t Value() const
+    {
+        return hash_;
+    }
+
+  private:
+    std::uint64_t hash_ = 0xcbf29ce484222325ULL;
+};
+
+// Encodes values onto a stream, variable size encodings are prefixed with their size. Keeps the checksum of everything
+// written so far.
+class StreamWriter
+{
+  public:
+    explicit StreamWriter(std::ostream& out) : out_(out)
+    {
+    }
+
+    void WriteBytes(const void* data, std::size_t size)
+    {
+        out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        checksum_.Update(data, size);
+    }
+
+    template <class T> void Write(const T& value)
+    {
+        const std::uint64_t size = Codec<T>::Size(value);
+        if constexpr (!Codec<T>::kFixedSize)
+        {
+            WriteBytes(&size, sizeof(size));
+        }
+        buffer_.resize(size);
+        Codec<T>::Encode(value, buffer_.data());
+        WriteBytes(buffer_.data(), size);
+    }
+
+    // Writes the checksum of everything written so far, the checksum itself is not covered by it
+    void WriteChecksum()
+    {
+        const std::uint64_t checksum = checksum_.Value();
+        out_.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    }
+
+    [[nodiscard]] bool Good() const
+    {
+        return static_cast<bool>(out_);
+    }
+
+  private:
+    std::ostream& out_;
+    Checksum checksum_;
+    std::vector<std::byte> buffer_;
+};
+
+// Decodes values written by StreamWriter
+class StreamReader
+{
+  public:
+    explicit StreamReader(std::istream& in) : in_(in)
+    {
+    }
+
+    bool ReadBytes(void* data, std::size_t size)
+    {
+        if (!in_.read(static_cast<char*>(data), static_cast<std::streamsize>(size)))
+        {
+            return false;
+        }
+        checksum_.Update(data, size);
+        return true;
+    }
+
+    template <class T> std::optional<T> Read()
+    {
+        std::uint64_t size;
+        if constexpr (Codec<T>::kFixedSize)
+        {
+            size = Codec<T>::kSize;
+        }
+        else if (!ReadBytes(&size, sizeof(size)))
+        {
+            return std::nullopt;
+        }
+        // The buffer grows only as data actually arrives, a corrupted size can't cause a huge allocation
+        static constexpr std::uint64_t kChunkSize = 64 * 1024;
+        buffer_.clear();
+        while (buffer_.size() < size)
+        {
+            const std::size_t offset = buffer_.size();
+            const auto chunk = static_cast<std::size_t>(std::min(size - offset, kChunkSize));
+            buffer_.resize(offset + chunk);
+            if (!ReadBytes(buffer_.data() + offset, chunk))
+            {
+                return std::nullopt;
+            }
+        }
+        return Codec<T>::Decode(buffer_.data(), buffer_.size());
+    }
+
+    // Reads the checksum written by StreamWriter::WriteChecksum and compares it with the checksum of everything read
+    [[nodiscard]] bool VerifyChecksum()
+    {
+        const std::uint64_t expected = checksum_.Value();
+        std::uint64_t checksum;
+        if (!in_.read(reinterpret_cast<char*>(&checksum), sizeof(checksum)))
+        {
+            return false;
+        }
+        return checksum == expected;
+    }
+
+  private:
+    std::istream& in_;
+    Checksum checksum_;
+    std::vector<std::byte> buffer_;
+};
+
+#endif // MAP_CODEC_H
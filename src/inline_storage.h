@@ -0,0 +1,139 @@
+#ifndef MAP_INLINE_STORAGE_H
+#define MAP_INLINE_STORAGE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Fixed capacity array of up to "kCapacity" elements stored inside the object itself, so it never allocates. Elements
+// stay contiguous, insertions and erasures shift the elements behind them.
+template <class T, std::size_t kCapacity> class InlineStorage
+{
+    static_assert(std::is_nothrow_move_constructible_v<T> && std::is_nothrow_move_assignable_v<T>,
+                  "Elements are shifted around by moving them");
+
+  public:
+    InlineStorage() = default;
+    InlineStorage(const InlineStorage& other)
+    {
+        for (const T& element : other)
+        {
+            std::construct_at(end(), element);
+            ++size_;
+        }
+    }
+    InlineStorage(InlineStorage&& other) noexcept
+    {
+        for (T& element : other)
+        {
+            PushBack(std::move(element));
+        }
+        other.Clear();
+    }
+    InlineStorage& operator=(const InlineStorage& other)
+    {
+        if (this != &other)
+        {
+            InlineStorage copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    InlineStorage& operator=(InlineStorage&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Clear();
+            for (T& element : other)
+            {
+                PushBack(std::move(element));
+            }
+            other.Clear();
+        }
+        return *this;
+    }
+    ~InlineStorage()
+    {
+        Clear();
+    }
+
+    [[nodiscard]] std::size_t Size() const
+    {
+        return size_;
+    }
+    [[nodiscard]] bool Full() const
+    {
+        return size_ == kCapacity;
+    }
+
+    void PushBack(T&& value) noexcept
+    {
+        assert(!Full());
+        std::construct_at(end(), std::move(value));
+        ++size_;
+    }
+
+    // Inserts "value" in front of "position" and returns a pointer to it
+    T* Insert(T* position, T&& value) noexcept
+    {
+        assert(!Full());
+        if (position == end())
+        {
+            PushBack(std::move(value));
+            return position;
+        }
+        std::construct_at(end(), std::move(*(end() - 1)));
+        std::move_backward(position, end() - 1, end());
+        *position = std::move(value);
+        ++size_;
+        return position;
+    }
+
+    // Removes the element at "position" and returns a pointer to the element that followed it
+    T* Erase(T* position) noexcept
+    {
+        assert(position != end());
+        std::move(position + 1, end(), position);
+        std::destroy_at(end() - 1);
+        --size_;
+        return position;
+    }
+
+    void Clear() noexcept
+    {
+        std::destroy(begin(), end());
+        size_ = 0;
+    }
+
+    T* begin()
+    {
+        return std::launder(reinterpret_cast<T*>(storage_));
+    }
+    T* end()
+    {
+        return begin() + size_;
+    }
+    const T* begin() const
+    {
+        return std::launder(reinterpret_cast<const T*>(storage_));
+    }
+    const T* end() const
+    {
+        return begin() + size_;
+    }
+
+  private:
+    alignas(T) std::byte storage_[kCapacity * sizeof(T)];
+    std::size_t size_ = 0;
+};
+
+// No inline elements at all, takes up no space when declared [[no_unique_address]]
+template <class T> class InlineStorage<T, 0>
+{
+};
+
+#endif // MAP_INLINE_STORAGE_H
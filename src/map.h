@@ -1,25 +1,876 @@
 #ifndef MAP_MAP_H
 #define MAP_MAP_H
 
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
+#include "codec.h"
+#include "inline_storage.h"
 #include "rbtree.h"
 
-template <class KeyType, class ValueType> class Map
+// Ordered map on top of RBTree. With a non-zero "kInlineCapacity", up to that many elements are kept in a sorted array
+// inside the Map object itself and no memory is allocated for them. Inserting past the capacity moves the elements
+// into the tree, and the map moves back to the array once erasing leaves at most half the capacity. Either move
+// invalidates all iterators.
+template <class KeyType, class ValueType, std::size_t kInlineCapacity = 0> class Map
 {
+  private:
+    using Tree = RBTree<KeyType, ValueType>;
+    using tree_iterator = typename Tree::iterator;
+    static constexpr bool kHasInlineStorage = kInlineCapacity > 0;
+    static constexpr std::size_t kDemoteSize = kInlineCapacity / 2;
+    // Whether an argument can be used to look up a key without constructing a KeyType first
+    template <typename Arg> static constexpr bool kIsKey = std::is_same_v<std::remove_cvref_t<Arg>, KeyType>;
+
+  public:
+    using value_type = typename Tree::value_type;
+
+    // Points either into the inline array or into the tree
+    class SmallMapIterator
+    {
+      public:
+        using pointer = value_type*;
+        using const_pointer = const value_type*;
+        using reference = value_type&;
+        using const_reference = const value_type&;
+
+      public:
+        SmallMapIterator() = default;
+        explicit SmallMapIterator(value_type* element) : element_(element)
+        {
+        }
+        explicit SmallMapIterator(tree_iterator tree_iterator) : tree_iterator_(tree_iterator)
+        {
+        }
+
+        [[nodiscard]] bool operator==(const SmallMapIterator& other) const
+        {
+            return element_ == other.element_ && tree_iterator_ == other.tree_iterator_;
+        }
+        [[nodiscard]] bool operator!=(const SmallMapIterator& other) const
+        {
+            return !(*this == other);
+        }
+
+        reference operator*()
+        {
+            return element_ ? *element_ : *tree_iterator_;
+        }
+        const_reference operator*() const
+        {
+            return element_ ? *element_ : *tree_iterator_;
+        }
+        pointer operator->()
+        {
+            return &(**this);
+        }
+        const_pointer operator->() const
+        {
+            return &(**this);
+        }
+
+        SmallMapIterator& operator++()
+        {
+            MAP_PERF_SCOPE(ITERATE);
+            if (element_)
+            {
+                ++element_;
+            }
+            else
+            {
+                ++tree_iterator_;
+            }
+            return *this;
+        }
+        SmallMapIterator& operator--()
+        {
+            MAP_PERF_SCOPE(ITERATE);
+            if (element_)
+            {
+                --element_;
+            }
+            else
+            {
+                --tree_iterator_;
+            }
+            return *this;
+        }
+        SmallMapIterator operator++(int)
+        {
+            MAP_PERF_SCOPE(ITERATE);
+            auto temp(*this);
+            ++(*this);
+            return temp;
+        }
+        SmallMapIterator operator--(int)
+        {
+            MAP_PERF_SCOPE(ITERATE);
+            auto temp(*this);
+            --(*this);
+            return temp;
+        }
+
+      private:
+        friend class Map;
+
+        value_type* element_ = nullptr; // Set when pointing into the inline array
+        tree_iterator tree_iterator_;
+    };
+
+    // Range cursor over either the inline array or the tree, see RBTree::RangeCursor
+    class SmallRangeCursor
+    {
+      public:
+        SmallRangeCursor() = default;
+        SmallRangeCursor(value_type* first, value_type* stop) : element_(first), stop_(stop)
+        {
+        }
+        explicit SmallRangeCursor(typename Tree::RangeCursor tree_cursor) : tree_cursor_(tree_cursor)
+        {
+        }
+
+        [[nodiscard]] bool Done() const
+        {
+            return element_ ? element_ == stop_ : tree_cursor_.Done();
+        }
+
+        value_type& operator*() const
+        {
+            return element_ ? *element_ : *tree_cursor_;
+        }
+        value_type* operator->() const
+        {
+            return &(**this);
+        }
+
+        SmallRangeCursor& operator++()
+        {
+            MAP_PERF_SCOPE(ITERATE);
+            if (element_)
+            {
+                ++element_;
+            }
+            else
+            {
+                ++tree_cursor_;
+            }
+            return *this;
+        }
+
+        template <typename Visitor> std::size_t VisitBatch(std::size_t max_count, Visitor&& visitor)
+        {
+            std::size_t visited = 0;
+            for (; visited < max_count && !Done(); ++visited)
+            {
+                visitor(**this);
+                ++(*this);
+            }
+            return visited;
+        }
+
+        std::size_t Fill(std::span<value_type> out)
+        {
+            return VisitBatch(out.size(), [out, i = std::size_t{0}](const value_type& element) mutable {
+                out[i++] = element;
+            });
+        }
+
+      private:
+        value_type* element_ = nullptr; // Set when iterating over the inline array
+        value_type* stop_ = nullptr;
+        typename Tree::RangeCursor tree_cursor_;
+    };
+
+    using iterator = std::conditional_t<kHasInlineStorage, SmallMapIterator, tree_iterator>;
+    using range_cursor = std::conditional_t<kHasInlineStorage, SmallRangeCursor, typename Tree::RangeCursor>;
+
+    // Starts every lookup from where the previous one landed, see RBTree::FingerCursor. Insertions and erasures may
+    // invalidate it until the next Reset().
+    class FingerCursor
+    {
+      public:
+        explicit FingerCursor(Map& map) : map_(&map), finger_(map.end())
+        {
+        }
+
+        iterator LowerBound(const KeyType& key)
+        {
+            const iterator result = map_->LowerBound(finger_, key);
+            if (result != map_->end())
+            {
+                finger_ = result;
+            }
+            return result;
+        }
+        iterator Find(const KeyType& key)
+        {
+            const iterator result = LowerBound(key);
+            if (result != map_->end() && result->first == key)
+            {
+                return result;
+            }
+            return map_->end();
+        }
+
+        void Reset()
+        {
+            finger_ = map_->end();
+        }
+
+      private:
+        Map* map_;
+        iterator finger_;
+    };
+
   public:
+    Map() = default;
+
+    // Copies the tree structure node for node, along with any changes recorded for the next checkpoint
+    Map(const Map& other)
+        requires std::is_copy_constructible_v<value_type>
+        : rb_tree_(other.rb_tree_), inline_(other.inline_)
+    {
+        if (other.changed_keys_)
+        {
+            changed_keys_ = std::make_unique<RBTree<KeyType, bool>>(*other.changed_keys_);
+        }
+    }
+
+    Map& operator=(const Map& other)
+        requires std::is_copy_constructible_v<value_type>
+    {
+        Map copy(other);
+        Swap(copy);
+        return *this;
+    }
+
+    Map(Map&& other) noexcept = default;
+    Map& operator=(Map&& other) noexcept = default;
+
+    // Exchanges the contents of two maps, in O(1) unless there are inline elements to exchange
+    void Swap(Map& other) noexcept
+    {
+        rb_tree_.Swap(other.rb_tree_);
+        std::swap(inline_, other.inline_);
+        changed_keys_.swap(other.changed_keys_);
+    }
+
+    [[nodiscard]] Map Clone() const
+        requires std::is_copy_constructible_v<value_type>
+    {
+        return Map(*this);
+    }
+
+    // Relocates the tree's nodes into contiguous memory in key order, see RBTree::Compact. Inline elements are already
+    // contiguous. Invalidates all iterators.
+    void Compact()
+    {
+        rb_tree_.Compact();
+    }
+
     [[nodiscard]] std::size_t Size() const
     {
-        return rb_tree_.Size();
+        if constexpr (kHasInlineStorage)
+        {
+            return inline_.Size() + rb_tree_.Size();
+        }
+        else
+        {
+            return rb_tree_.Size();
+        }
     }
     [[nodiscard]] bool Empty() const
     {
         return Size() == 0;
     }
 
+    std::pair<iterator, bool> Insert(const value_type& element)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                return recordInsertion(insertInline(element.first, [&element]() { return element; }));
+            }
+        }
+        return recordInsertion(fromTree(rb_tree_.Insert(element)));
+    }
+    std::pair<iterator, bool> Insert(value_type&& element)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                return recordInsertion(insertInline(element.first, [&element]() { return std::move(element); }));
+            }
+        }
+        return recordInsertion(fromTree(rb_tree_.Insert(std::move(element))));
+    }
+
+    template <typename... Args> std::pair<iterator, bool> Emplace(Args&&... args)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                return recordInsertion(emplaceInline(std::forward<Args>(args)...));
+            }
+        }
+        return recordInsertion(fromTree(rb_tree_.Emplace(std::forward<Args>(args)...)));
+    }
+
+    template <typename Key, typename... Args> std::pair<iterator, bool> TryEmplace(Key&& key, Args&&... args)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                return recordInsertion(insertInline(key, [&]() {
+                    return value_type(std::piecewise_construct, std::forward_as_tuple(std::forward<Key>(key)),
+                                      std::forward_as_tuple(std::forward<Args>(args)...));
+                }));
+            }
+        }
+        return recordInsertion(fromTree(rb_tree_.TryEmplace(std::forward<Key>(key), std::forward<Args>(args)...)));
+    }
+
+    template <typename Key, typename Value> std::pair<iterator, bool> InsertOrAssign(Key&& key, Value&& value)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        std::pair<iterator, bool> result;
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                // "value" is only consumed by one of the two branches
+                result = insertInline(key, [&]() {
+                    return value_type(std::piecewise_construct, std::forward_as_tuple(std::forward<Key>(key)),
+                                      std::forward_as_tuple(std::forward<Value>(value)));
+                });
+                if (!result.second)
+                {
+                    result.first->second = std::forward<Value>(value);
+                }
+                recordChange(result.first->first, true);
+                return result;
+            }
+        }
+        result = fromTree(rb_tree_.InsertOrAssign(std::forward<Key>(key), std::forward<Value>(value)));
+        recordChange(result.first->first, true);
+        return result;
+    }
+
+    iterator Erase(iterator to_delete)
+    {
+        MAP_PERF_SCOPE(ERASE);
+        recordChange(to_delete->first, false);
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                return iterator(inline_.Erase(to_delete.element_));
+            }
+            const auto next = rb_tree_.Erase(to_delete.tree_iterator_);
+            if (rb_tree_.Size() <= kDemoteSize)
+            {
+                return demote(next);
+            }
+            return iterator(next);
+        }
+        else
+        {
+            return rb_tree_.Erase(to_delete);
+        }
+    }
+
+    iterator Find(const KeyType& key)
+    {
+        MAP_PERF_SCOPE(FIND);
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                value_type* const element = inlineLowerBound(key);
+                if (element != inline_.end() && element->first == key)
+                {
+                    return iterator(element);
+                }
+                return end();
+            }
+        }
+        return fromTree(rb_tree_.Find(key));
+    }
+
+    template <std::size_t kInterleave = 16> void FindMany(std::span<const KeyType> keys, std::span<iterator> out)
+    {
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                for (std::size_t i = 0; i < keys.size(); ++i)
+                {
+                    out[i] = Find(keys[i]);
+                }
+                return;
+            }
+            // The tree hands out its own iterators, collect them in chunks and wrap them
+            std::array<tree_iterator, 64> chunk;
+            for (std::size_t offset = 0; offset < keys.size(); offset += chunk.size())
+            {
+                const auto chunk_keys = keys.subspan(offset, std::min(chunk.size(), keys.size() - offset));
+                rb_tree_.template FindMany<kInterleave>(chunk_keys, chunk);
+                for (std::size_t i = 0; i < chunk_keys.size(); ++i)
+                {
+                    out[offset + i] = iterator(chunk[i]);
+                }
+            }
+        }
+        else
+        {
+            rb_tree_.template FindMany<kInterleave>(keys, out);
+        }
+    }
+
+    iterator LowerBound(const KeyType& key)
+    {
+        MAP_PERF_SCOPE(FIND);
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                return iterator(inlineLowerBound(key));
+            }
+        }
+        return fromTree(rb_tree_.LowerBound(key));
+    }
+
+    // Finger search, see RBTree::LowerBound(finger, key). The inline array is searched from scratch.
+    iterator LowerBound(iterator finger, const KeyType& key)
+    {
+        MAP_PERF_SCOPE(FIND);
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                return iterator(inlineLowerBound(key));
+            }
+            // A finger into the inline array predates the promotion to the tree
+            return iterator(rb_tree_.LowerBound(finger.element_ ? rb_tree_.end() : finger.tree_iterator_, key));
+        }
+        else
+        {
+            return rb_tree_.LowerBound(finger, key);
+        }
+    }
+    iterator Find(iterator finger, const KeyType& key)
+    {
+        MAP_PERF_SCOPE(FIND);
+        const iterator result = LowerBound(finger, key);
+        if (result != end() && result->first == key)
+        {
+            return result;
+        }
+        return end();
+    }
+
+    range_cursor Range(const KeyType& lo, const KeyType& hi)
+    {
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                if (!(lo < hi))
+                {
+                    return range_cursor();
+                }
+                return range_cursor(inlineLowerBound(lo), inlineLowerBound(hi));
+            }
+            return range_cursor(rb_tree_.Range(lo, hi));
+        }
+        else
+        {
+            return rb_tree_.Range(lo, hi);
+        }
+    }
+
+    template <typename Visitor> std::size_t Scan(const KeyType& lo, const KeyType& hi, Visitor&& visitor)
+    {
+        std::size_t visited = 0;
+        for (auto cursor = Range(lo, hi); !cursor.Done(); ++cursor)
+        {
+            visitor(*cursor);
+            ++visited;
+        }
+        return visited;
+    }
+
+    // Writes every element to "out" in key order. Elements are encoded one at a time, so memory use doesn't depend on
+    // the size of the map. Returns false if the stream failed.
+    bool WriteTo(std::ostream& out)
+    {
+        StreamWriter writer(out);
+        writeHeader(writer, kSnapshotMagic, Size());
+        for (const auto& [key, value] : *this)
+        {
+            writer.Write(key);
+            writer.Write(value);
+        }
+        writer.WriteChecksum();
+        return writer.Good();
+    }
+
+    // Replaces the contents of the map with the elements written to "in" by WriteTo. The tree is built directly from
+    // the sorted stream in O(n) rather than by inserting the elements one by one. Returns false and leaves the map
+    // empty if the stream is malformed or corrupted. The loaded contents become the new baseline for change tracking.
+    bool ReadFrom(std::istream& in)
+    {
+        if (changed_keys_)
+        {
+            changed_keys_->Clear();
+        }
+        if constexpr (kHasInlineStorage)
+        {
+            inline_.Clear();
+        }
+        StreamReader reader(in);
+        const auto count = readHeader(reader, kSnapshotMagic);
+        const bool built = count && rb_tree_.AssignSorted(*count, [&reader]() -> std::optional<value_type> {
+            auto key = reader.Read<KeyType>();
+            if (!key)
+            {
+                return std::nullopt;
+            }
+            auto value = reader.Read<ValueType>();
+            if (!value)
+            {
+                return std::nullopt;
+            }
+            return value_type(std::move(*key), std::move(*value));
+        });
+        if (!built || !reader.VerifyChecksum())
+        {
+            rb_tree_.Clear();
+            return false;
+        }
+        if constexpr (kHasInlineStorage)
+        {
+            if (rb_tree_.Size() <= kInlineCapacity)
+            {
+                demote(rb_tree_.end());
+            }
+        }
+        return true;
+    }
+
+    // Starts recording which keys are inserted or erased, so that WriteCheckpoint can write only the elements that
+    // changed. Any changes recorded so far are discarded.
+    void StartChangeTracking()
+    {
+        changed_keys_ = std::make_unique<RBTree<KeyType, bool>>();
+    }
+
+    // Insert and Erase are tracked automatically, values modified in place through an iterator have to be reported
+    void MarkChanged(const KeyType& key)
+    {
+        recordChange(key, Find(key) != end());
+    }
+
+    // Writes the elements inserted, modified or erased since change tracking started or since the previous checkpoint,
+    // then starts a new checkpoint interval. Requires StartChangeTracking. Returns false if the stream failed.
+    bool WriteCheckpoint(std::ostream& out)
+    {
+        assert(changed_keys_);
+        StreamWriter writer(out);
+        writeHeader(writer, kCheckpointMagic, changed_keys_->Size());
+        for (const auto& [key, present] : *changed_keys_)
+        {
+            if (present)
+            {
+                writeChangeKind(writer, ChangeKind::UPSERT);
+                writer.Write(key);
+                writer.Write(Find(key)->second);
+            }
+            else
+            {
+                writeChangeKind(writer, ChangeKind::ERASE);
+                writer.Write(key);
+            }
+        }
+        writer.WriteChecksum();
+        changed_keys_->Clear();
+        return writer.Good();
+    }
+
+    // Replays a checkpoint written by WriteCheckpoint. The checkpoint is validated before any change is applied, so the
+    // map is left untouched if it returns false.
+    bool ApplyCheckpoint(std::istream& in)
+    {
+        StreamReader reader(in);
+        const auto count = readHeader(reader, kCheckpointMagic);
+        if (!count)
+        {
+            return false;
+        }
+        std::vector<std::pair<KeyType, std::optional<ValueType>>> changes;
+        for (std::uint64_t i = 0; i < *count; ++i)
+        {
+            std::uint8_t kind;
+            if (!reader.ReadBytes(&kind, sizeof(kind)) ||
+                (kind != static_cast<std::uint8_t>(ChangeKind::UPSERT) &&
+                 kind != static_cast<std::uint8_t>(ChangeKind::ERASE)))
+            {
+                return false;
+            }
+            auto key = reader.Read<KeyType>();
+            if (!key)
+            {
+                return false;
+            }
+            std::optional<ValueType> value;
+            if (kind == static_cast<std::uint8_t>(ChangeKind::UPSERT) && !(value = reader.Read<ValueType>()))
+            {
+                return false;
+            }
+            changes.emplace_back(std::move(*key), std::move(value));
+        }
+        if (!reader.VerifyChecksum())
+        {
+            return false;
+        }
+
+        for (auto& [key, value] : changes)
+        {
+            if (value)
+            {
+                InsertOrAssign(std::move(key), std::move(*value));
+            }
+            else if (auto it = Find(key); it != end())
+            {
+                Erase(it);
+            }
+        }
+        return true;
+    }
+
+    iterator begin()
+    {
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                return iterator(inline_.begin());
+            }
+        }
+        return fromTree(rb_tree_.begin());
+    }
+    iterator end()
+    {
+        if constexpr (kHasInlineStorage)
+        {
+            if (isInline())
+            {
+                return iterator(inline_.end());
+            }
+        }
+        return fromTree(rb_tree_.end());
+    }
+
+  private:
+    static constexpr std::array<char, 8> kSnapshotMagic{'R', 'B', 'M', 'A', 'P', 'S', 'N', 'P'};
+    static constexpr std::array<char, 8> kCheckpointMagic{'R', 'B', 'M', 'A', 'P', 'C', 'K', 'P'};
+    static constexpr std::uint32_t kStreamVersion = 1;
+
+    enum class ChangeKind : std::uint8_t
+    {
+        UPSERT = 1,
+        ERASE = 2
+    };
+
+    static void writeHeader(StreamWriter& writer, const std::array<char, 8>& magic, std::uint64_t count)
+    {
+        writer.WriteBytes(magic.data(), magic.size());
+        writer.WriteBytes(&kStreamVersion, sizeof(kStreamVersion));
+        writer.WriteBytes(&count, sizeof(count));
+    }
+
+    // Returns the record count stored in the header, or std::nullopt if the header doesn't match
+    static std::optional<std::uint64_t> readHeader(StreamReader& reader, const std::array<char, 8>& magic)
+    {
+        std::array<char, 8> stream_magic;
+        std::uint32_t version;
+        std::uint64_t count;
+        if (!reader.ReadBytes(stream_magic.data(), stream_magic.size()) || stream_magic != magic ||
+            !reader.ReadBytes(&version, sizeof(version)) || version != kStreamVersion ||
+            !reader.ReadBytes(&count, sizeof(count)))
+        {
+            return std::nullopt;
+        }
+        return count;
+    }
+
+    static void writeChangeKind(StreamWriter& writer, ChangeKind kind)
+    {
+        const auto byte = static_cast<std::uint8_t>(kind);
+        writer.WriteBytes(&byte, sizeof(byte));
+    }
+
+    // The inline array is in use whenever the tree is empty
+    [[nodiscard]] bool isInline() const
+    {
+        return kHasInlineStorage && rb_tree_.Size() == 0;
+    }
+
+    static iterator fromTree(tree_iterator it)
+    {
+        return iterator(it);
+    }
+    static std::pair<iterator, bool> fromTree(std::pair<tree_iterator, bool> result)
+    {
+        return {iterator(result.first), result.second};
+    }
+
+    std::pair<iterator, bool> recordInsertion(std::pair<iterator, bool> result)
+    {
+        if (result.second)
+        {
+            recordChange(result.first->first, true);
+        }
+        return result;
+    }
+
+    value_type* inlineLowerBound(const KeyType& key)
+    {
+        return std::partition_point(inline_.begin(), inline_.end(),
+                                    [&key](const value_type& element) { return element.first < key; });
+    }
+
+    // Inserts the element returned by "make_element" unless "key" is already present, "make_element" is only called
+    // if the insertion takes place. Moves everything into the tree if the inline array is full.
+    template <typename MakeElement>
+    std::pair<iterator, bool> insertInline(const KeyType& key, MakeElement&& make_element)
+    {
+        value_type* const position = inlineLowerBound(key);
+        if (position != inline_.end() && position->first == key)
+        {
+            return {iterator(position), false};
+        }
+        if (!inline_.Full())
+        {
+            return {iterator(inline_.Insert(position, make_element())), true};
+        }
+        return {iterator(promote(position, make_element())), true};
+    }
+
+    // Emplace() into the inline array. Like RBTree::Emplace, a KeyType key is looked up before anything is
+    // constructed, any other arguments have to construct the element first.
+    template <typename Key, typename Value>
+        requires kIsKey<Key>
+    std::pair<iterator, bool> emplaceInline(Key&& key, Value&& value)
+    {
+        return insertInline(key, [&]() { return value_type(std::forward<Key>(key), std::forward<Value>(value)); });
+    }
+    template <typename... KeyArgs, typename... ValueArgs>
+    std::pair<iterator, bool> emplaceInline(std::piecewise_construct_t, std::tuple<KeyArgs...> key_args,
+                                            std::tuple<ValueArgs...> value_args)
+    {
+        if constexpr (sizeof...(KeyArgs) == 1 && (kIsKey<KeyArgs> && ...))
+        {
+            return insertInline(std::get<0>(key_args), [&]() {
+                return value_type(std::piecewise_construct, std::move(key_args), std::move(value_args));
+            });
+        }
+        else
+        {
+            value_type element(std::piecewise_construct, std::move(key_args), std::move(value_args));
+            return insertInline(element.first, [&element]() { return std::move(element); });
+        }
+    }
+    template <typename... Args> std::pair<iterator, bool> emplaceInline(Args&&... args)
+    {
+        value_type element(std::forward<Args>(args)...);
+        return insertInline(element.first, [&element]() { return std::move(element); });
+    }
+
+    // Builds the tree from the full inline array plus "element", which belongs in front of "position". Returns an
+    // iterator to "element".
+    tree_iterator promote(value_type* position, value_type&& element)
+    {
+        const auto element_index = static_cast<std::size_t>(position - inline_.begin());
+        value_type* next = inline_.begin();
+        bool element_pending = true;
+        rb_tree_.AssignSorted(inline_.Size() + 1, [&]() -> std::optional<value_type> {
+            if (element_pending && next == position)
+            {
+                element_pending = false;
+                return std::move(element);
+            }
+            return std::move(*next++);
+        });
+        inline_.Clear();
+
+        auto it = rb_tree_.begin();
+        for (std::size_t i = 0; i < element_index; ++i)
+        {
+            ++it;
+        }
+        return it;
+    }
+
+    // Moves all elements from the tree into the inline array, returns the iterator that now stands for "tree_position"
+    iterator demote(tree_iterator tree_position)
+    {
+        value_type* position = nullptr;
+        for (auto it = rb_tree_.begin(); it != rb_tree_.end(); ++it)
+        {
+            if (it == tree_position)
+            {
+                position = inline_.end();
+            }
+            inline_.PushBack(std::move(*it));
+        }
+        if (tree_position == rb_tree_.end())
+        {
+            position = inline_.end();
+        }
+        rb_tree_.Clear();
+        return iterator(position);
+    }
+
+    // "present" is false if the key was erased
+    void recordChange(const KeyType& key, bool present)
+    {
+        if (!changed_keys_)
+        {
+            return;
+        }
+        auto [it, inserted] = changed_keys_->Insert({key, present});
+        if (!inserted)
+        {
+            it->second = present;
+        }
+    }
+
   private:
-    RBTree<KeyType, ValueType> rb_tree_;
+    Tree rb_tree_;
+    [[no_unique_address]] InlineStorage<value_type, kInlineCapacity> inline_;
+    // Keys changed since the last checkpoint, mapped to whether they are still present. nullptr unless tracking.
+    std::unique_ptr<RBTree<KeyType, bool>> changed_keys_;
 };
 
 #endif // MAP_MAP_H
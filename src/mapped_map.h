@@ -0,0 +1,456 @@
+#ifndef MAP_MAPPED_MAP_H
+#define MAP_MAPPED_MAP_H
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "codec.h"
+
+// Read-only map served straight from a memory-mapped file written by MappedMap::Write. The file holds the entries
+// sorted by key in offset-based sections, so opening it does no deserialization and every process that maps the same
+// file shares its pages through the page cache.
+//
+// File layout, every section starts at a multiple of "kSectionAlignment":
+//      Header
+//      Key section
+//      Value section
+// The section of a fixed size type is the array of the encoded elements. The section of a variable size type is an
+// array of (entry_count + 1) uint64_t offsets followed by the encoded elements, element i occupies the bytes
+// [offsets[i], offsets[i + 1]) counted from the end of the offset array.
+template <class KeyType, class ValueType> class MappedMap
+{
+  private:
+    using key_view = typename Codec<KeyType>::view_type;
+    using value_view = typename Codec<ValueType>::view_type;
+
+    static constexpr std::array<char, 8> kMagic{'R', 'B', 'M', 'A', 'P', '\0', '\0', '\0'};
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::uint64_t kSectionAlignment = 64;
+
+    struct Header
+    {
+        std::array<char, 8> magic;
+        std::uint32_t version;
+        std::uint32_t key_size;   // Encoded size of a key, 0 if keys have a variable size
+        std::uint32_t value_size; // Encoded size of a value, 0 if values have a variable size
+        std::uint32_t reserved;
+        std::uint64_t entry_count;
+        std::uint64_t keys_offset;
+        std::uint64_t values_offset;
+        std::uint64_t file_size;
+        std::uint64_t checksum; // Checksum of everything that follows the header
+    };
+    static_assert(std::is_trivially_copyable_v<Header>);
+    static_assert(sizeof(Header) % kSectionAlignment == 0);
+
+    template <class T> static constexpr std::uint32_t encodedSize()
+    {
+        if constexpr (Codec<T>::kFixedSize)
+        {
+            return Codec<T>::kSize;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    template <class T> class Section
+    {
+      public:
+        Section() = default;
+        Section(const std::byte* begin, std::size_t count) : begin_(begin), count_(count)
+        {
+        }
+
+        typename Codec<T>::view_type operator[](std::size_t index) const
+        {
+            assert(index < count_);
+            if constexpr (Codec<T>::kFixedSize)
+            {
+                return Codec<T>::View(begin_ + index * Codec<T>::kSize, Codec<T>::kSize);
+            }
+            else
+            {
+                const auto* offsets = reinterpret_cast<const std::uint64_t*>(begin_);
+                const std::byte* elements = begin_ + (count_ + 1) * sizeof(std::uint64_t);
+                // Open only checked the last offset, which bounds the elements. A corrupted entry reads as empty
+                // rather than outside the section.
+                const std::uint64_t begin = offsets[index];
+                const std::uint64_t end = offsets[index + 1];
+                if (begin > end || end > offsets[count_])
+                {
+                    return Codec<T>::View(elements, 0);
+                }
+                return Codec<T>::View(elements + begin, end - begin);
+            }
+        }
+
+      private:
+        const std::byte* begin_ = nullptr;
+        std::size_t count_ = 0;
+    };
+
+    // Buffered output that keeps track of the position in the file and of the checksum of everything written
+    class FileWriter
+    {
+      public:
+        FileWriter(std::ofstream& out, std::uint64_t position) : out_(out), position_(position)
+        {
+        }
+
+        void Write(const void* data, std::size_t size)
+        {
+            out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            checksum_.Update(data, size);
+            position_ += size;
+        }
+
+        void PadTo(std::uint64_t alignment)
+        {
+            static constexpr std::array<std::byte, kSectionAlignment> kZeros{};
+            assert(alignment <= kZeros.size());
+            const auto padding = (alignment - position_ % alignment) % alignment;
+            Write(kZeros.data(), padding);
+        }
+
+        [[nodiscard]] std::uint64_t Position() const
+        {
+            return position_;
+        }
+        [[nodiscard]] std::uint64_t ChecksumValue() const
+        {
+            return checksum_.Value();
+        }
+
+      private:
+        std::ofstream& out_;
+        std::uint64_t position_;
+        Checksum checksum_;
+    };
+
+  public:
+    class MappedIterator
+    {
+      public:
+        using value_type = std::pair<key_view, value_view>;
+
+        // Elements are assembled on access, so "->" hands out a pointer into a temporary
+        struct ArrowProxy
+        {
+            value_type element;
+            const value_type* operator->() const
+            {
+                return &element;
+            }
+        };
+
+      public:
+        MappedIterator() = default;
+        MappedIterator(const MappedMap* map, std::size_t index) : map_(map), index_(index)
+        {
+        }
+
+        [[nodiscard]] bool operator==(const MappedIterator& other) const
+        {
+            return map_ == other.map_ && index_ == other.index_;
+        }
+        [[nodiscard]] bool operator!=(const MappedIterator& other) const
+        {
+            return !(*this == other);
+        }
+
+        value_type operator*() const
+        {
+            return {map_->keys_[index_], map_->values_[index_]};
+        }
+        ArrowProxy operator->() const
+        {
+            return {**this};
+        }
+
+        MappedIterator& operator++()
+        {
+            ++index_;
+            return *this;
+        }
+        MappedIterator& operator--()
+        {
+            --index_;
+            return *this;
+        }
+        MappedIterator operator++(int)
+        {
+            auto temp(*this);
+            ++index_;
+            return temp;
+        }
+        MappedIterator operator--(int)
+        {
+            auto temp(*this);
+            --index_;
+            return temp;
+        }
+
+      private:
+        const MappedMap* map_ = nullptr;
+        std::size_t index_ = 0;
+    };
+
+    using iterator = MappedIterator;
+
+  public:
+    MappedMap(const MappedMap&) = delete;
+    MappedMap& operator=(const MappedMap&) = delete;
+    MappedMap(MappedMap&& other) noexcept
+    {
+        swap(other);
+    }
+    MappedMap& operator=(MappedMap&& other) noexcept
+    {
+        MappedMap temp(std::move(other));
+        swap(temp);
+        return *this;
+    }
+    ~MappedMap()
+    {
+        if (data_)
+        {
+            ::munmap(const_cast<std::byte*>(data_), size_);
+        }
+    }
+
+    // Serializes the entries of "map", which must iterate in ascending key order, to the file at "path". Returns false
+    // if the file could not be written.
+    template <class MapType> static bool Write(MapType& map, const std::string& path)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            return false;
+        }
+
+        Header header{};
+        header.magic = kMagic;
+        header.version = kVersion;
+        header.key_size = encodedSize<KeyType>();
+        header.value_size = encodedSize<ValueType>();
+        header.entry_count = map.Size();
+        // Placeholder, rewritten once the section offsets and the checksum are known
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        FileWriter writer(out, sizeof(header));
+        header.keys_offset = writer.Position();
+        writeSection<KeyType>(writer, map, [](const auto& element) -> const KeyType& { return element.first; });
+        writer.PadTo(kSectionAlignment);
+        header.values_offset = writer.Position();
+        writeSection<ValueType>(writer, map, [](const auto& element) -> const ValueType& { return element.second; });
+        writer.PadTo(kSectionAlignment);
+        header.file_size = writer.Position();
+        header.checksum = writer.ChecksumValue();
+
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        return static_cast<bool>(out.flush());
+    }
+
+    // Maps the file at "path". Only the header is validated, which keeps opening O(1) regardless of the file size; call
+    // VerifyChecksum() to check the contents as well. Lookups on a corrupted file that wasn't verified stay inside the
+    // mapping but may return wrong results. Returns std::nullopt if the file can't be mapped or was not written by
+    // MappedMap<KeyType, ValueType>::Write.
+    static std::optional<MappedMap> Open(const std::string& path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return std::nullopt;
+        }
+        struct stat file_stat{};
+        void* mapping = MAP_FAILED;
+        if (::fstat(fd, &file_stat) == 0 && static_cast<std::uint64_t>(file_stat.st_size) >= sizeof(Header))
+        {
+            mapping = ::mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        }
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return std::nullopt;
+        }
+
+        MappedMap mapped_map;
+        mapped_map.data_ = static_cast<const std::byte*>(mapping);
+        mapped_map.size_ = static_cast<std::size_t>(file_stat.st_size);
+        if (!mapped_map.load())
+        {
+            return std::nullopt;
+        }
+        return mapped_map;
+    }
+
+    // Reads the whole mapping, returns false if its contents don't match the checksum recorded when it was written
+    [[nodiscard]] bool VerifyChecksum() const
+    {
+        Checksum checksum;
+        checksum.Update(data_ + sizeof(Header), size_ - sizeof(Header));
+        return checksum.Value() == header_.checksum;
+    }
+
+    [[nodiscard]] std::size_t Size() const
+    {
+        return static_cast<std::size_t>(header_.entry_count);
+    }
+    [[nodiscard]] bool Empty() const
+    {
+        return Size() == 0;
+    }
+
+    // Returns an iterator to the element with key "key", or end() if there is no such element
+    iterator Find(const KeyType& key) const
+    {
+        auto it = LowerBound(key);
+        if (it != end() && it->first == key)
+        {
+            return it;
+        }
+        return end();
+    }
+
+    // Returns an iterator to the first element whose key is not less than "key", or end() if there is no such element
+    iterator LowerBound(const KeyType& key) const
+    {
+        std::size_t first = 0;
+        std::size_t count = Size();
+        while (count > 0)
+        {
+            const std::size_t step = count / 2;
+            if (keys_[first + step] < key)
+            {
+                first += step + 1;
+                count -= step + 1;
+            }
+            else
+            {
+                count = step;
+            }
+        }
+        return iterator(this, first);
+    }
+
+    iterator begin() const
+    {
+        return iterator(this, 0);
+    }
+    iterator end() const
+    {
+        return iterator(this, Size());
+    }
+
+  private:
+    MappedMap() = default;
+
+    void swap(MappedMap& other) noexcept
+    {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(header_, other.header_);
+        std::swap(keys_, other.keys_);
+        std::swap(values_, other.values_);
+    }
+
+    template <class T, class MapType, class Projection>
+    static void writeSection(FileWriter& writer, MapType& map, Projection project)
+    {
+        if constexpr (!Codec<T>::kFixedSize)
+        {
+            std::uint64_t offset = 0;
+            writer.Write(&offset, sizeof(offset));
+            for (const auto& element : map)
+            {
+                offset += Codec<T>::Size(project(element));
+                writer.Write(&offset, sizeof(offset));
+            }
+        }
+        std::vector<std::byte> buffer;
+        for (const auto& element : map)
+        {
+            const T& value = project(element);
+            buffer.resize(Codec<T>::Size(value));
+            Codec<T>::Encode(value, buffer.data());
+            writer.Write(buffer.data(), buffer.size());
+        }
+    }
+
+    // Returns whether a section of "count" elements starting at "offset" ends before "limit"
+    template <class T>
+    [[nodiscard]] bool sectionFits(std::uint64_t offset, std::uint64_t count, std::uint64_t limit) const
+    {
+        if (offset % kSectionAlignment != 0 || offset > limit)
+        {
+            return false;
+        }
+        const std::uint64_t available = limit - offset;
+        if constexpr (Codec<T>::kFixedSize)
+        {
+            return count <= available / Codec<T>::kSize;
+        }
+        else
+        {
+            if (count >= available / sizeof(std::uint64_t))
+            {
+                return false;
+            }
+            const std::uint64_t offsets_size = (count + 1) * sizeof(std::uint64_t);
+            std::uint64_t elements_size;
+            std::memcpy(&elements_size, data_ + offset + count * sizeof(std::uint64_t), sizeof(elements_size));
+            return elements_size <= available - offsets_size;
+        }
+    }
+
+    [[nodiscard]] bool load()
+    {
+        std::memcpy(&header_, data_, sizeof(Header));
+        if (header_.magic != kMagic || header_.version != kVersion || header_.key_size != encodedSize<KeyType>() ||
+            header_.value_size != encodedSize<ValueType>() || header_.file_size != size_)
+        {
+            return false;
+        }
+        // The sections must lie inside the file, in order, before either is looked at
+        if (header_.keys_offset < sizeof(Header) || header_.keys_offset > header_.values_offset ||
+            header_.values_offset > header_.file_size)
+        {
+            return false;
+        }
+        if (!sectionFits<KeyType>(header_.keys_offset, header_.entry_count, header_.values_offset) ||
+            !sectionFits<ValueType>(header_.values_offset, header_.entry_count, header_.file_size))
+        {
+            return false;
+        }
+        keys_ = Section<KeyType>(data_ + header_.keys_offset, header_.entry_count);
+        values_ = Section<ValueType>(data_ + header_.values_offset, header_.entry_count);
+        return true;
+    }
+
+  private:
+    const std::byte* data_ = nullptr;
+    std::size_t size_ = 0;
+    Header header_{};
+    Section<KeyType> keys_;
+    Section<ValueType> values_;
+};
+
+#endif // MAP_MAPPED_MAP_H
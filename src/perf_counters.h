@@ -0,0 +1,363 @@
+#ifndef MAP_PERF_COUNTERS_H
+#define MAP_PERF_COUNTERS_H
+
+// Optional instrumentation of the map operations with Linux hardware performance counters. Defining MAP_PERF_COUNTERS
+// (the MAP_PERF_COUNTERS CMake option) wraps every insertion, erasure, lookup and iterator step in a PerfScope, which
+// adds the counters read around the operation to the calling thread's PerfProfiler. Without it MAP_PERF_SCOPE expands
+// to nothing and none of this is compiled.
+#ifdef MAP_PERF_COUNTERS
+
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+enum class PerfOperation : std::uint8_t
+{
+    INSERT,
+    ERASE,
+    FIND,
+    ITERATE,
+    COUNT
+};
+
+enum class PerfEvent : std::uint8_t
+{
+    CYCLES,
+    INSTRUCTIONS,
+    L1D_MISSES,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    COUNT
+};
+
+// The hardware counters of the calling thread, user space only, opened as one group so that they are read together
+// with a single system call. Events the machine or the kernel doesn't provide are left out, and when perf_event_open
+// isn't permitted at all (perf_event_paranoid, containers) none are available and every read returns zeros.
+class PerfCounters
+{
+  public:
+    static constexpr std::size_t kEventCount = static_cast<std::size_t>(PerfEvent::COUNT);
+    using Sample = std::array<std::uint64_t, kEventCount>;
+
+  public:
+    PerfCounters()
+    {
+        fds_.fill(-1);
+        slots_.fill(-1);
+        for (std::size_t event = 0; event < kEventCount; ++event)
+        {
+            const int fd = open(static_cast<PerfEvent>(event), leader_);
+            if (fd < 0)
+            {
+                if (error_.empty())
+                {
+                    error_ = std::strerror(errno);
+                }
+                continue;
+            }
+            if (leader_ < 0)
+            {
+                leader_ = fd;
+            }
+            fds_[event] = fd;
+            slots_[event] = open_count_++;
+        }
+        if (leader_ >= 0)
+        {
+            ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    ~PerfCounters()
+    {
+        for (const int fd : fds_)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    [[nodiscard]] bool Available(PerfEvent event) const
+    {
+        return fds_[static_cast<std::size_t>(event)] >= 0;
+    }
+    [[nodiscard]] bool AnyAvailable() const
+    {
+        return leader_ >= 0;
+    }
+    // Why the first unavailable event couldn't be opened, empty if all of them were
+    [[nodiscard]] const std::string& Error() const
+    {
+        return error_;
+    }
+
+    // Current values of the counters since they were opened, zero for unavailable events
+    [[nodiscard]] Sample Read() const
+    {
+        Sample sample{};
+        if (leader_ < 0)
+        {
+            return sample;
+        }
+        // PERF_FORMAT_GROUP layout: the number of events followed by their values in the order they were opened
+        std::array<std::uint64_t, kEventCount + 1> buffer{};
+        if (::read(leader_, buffer.data(), sizeof(buffer)) <= 0)
+        {
+            return sample;
+        }
+        for (std::size_t event = 0; event < kEventCount; ++event)
+        {
+            if (slots_[event] >= 0)
+            {
+                sample[event] = buffer[static_cast<std::size_t>(slots_[event]) + 1];
+            }
+        }
+        return sample;
+    }
+
+  private:
+    static int open(PerfEvent event, int group_fd)
+    {
+        perf_event_attr attributes{};
+        attributes.size = sizeof(attributes);
+        switch (event)
+        {
+        case PerfEvent::CYCLES:
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfEvent::INSTRUCTIONS:
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfEvent::L1D_MISSES:
+            attributes.type = PERF_TYPE_HW_CACHE;
+            attributes.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PerfEvent::LLC_MISSES:
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PerfEvent::BRANCH_MISSES:
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PerfEvent::COUNT:
+            return -1;
+        }
+        // The leader starts disabled and enables the whole group once every member is attached
+        attributes.disabled = group_fd < 0 ? 1 : 0;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_GROUP;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, group_fd, 0));
+    }
+
+    int leader_ = -1;
+    std::array<int, kEventCount> fds_;
+    // Position of each event in a group read, -1 if it isn't open
+    std::array<int, kEventCount> slots_;
+    int open_count_ = 0;
+    std::string error_;
+};
+
+// Everything recorded for one type of operation
+struct PerfStats
+{
+    static constexpr std::size_t kHistogramBuckets = 40;
+
+    std::uint64_t count = 0;
+    PerfCounters::Sample totals{};
+    std::uint64_t total_nanoseconds = 0;
+    // Bucket i counts the operations whose latency in nanoseconds has bit width i, i.e. lies in [2^(i-1), 2^i)
+    std::array<std::uint64_t, kHistogramBuckets> latency_histogram{};
+};
+
+// Per thread aggregate of the instrumented operations
+class PerfProfiler
+{
+  public:
+    static PerfProfiler& ThisThread()
+    {
+        static thread_local PerfProfiler profiler;
+        return profiler;
+    }
+
+    [[nodiscard]] const PerfCounters& Counters() const
+    {
+        return counters_;
+    }
+    [[nodiscard]] const PerfStats& Stats(PerfOperation operation) const
+    {
+        return stats_[static_cast<std::size_t>(operation)];
+    }
+    void Reset()
+    {
+        stats_ = {};
+    }
+
+    // Writes a table of the per operation averages followed by the latency histogram of every operation type
+    void Report(std::ostream& out) const
+    {
+        static constexpr std::array<const char*, kOperationCount> kOperationNames{"insert", "erase", "find", "iterate"};
+        if (!counters_.AnyAvailable())
+        {
+            out << "hardware counters unavailable (" << counters_.Error() << "), reporting latency only\n";
+        }
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << std::left << std::setw(10) << "operation" << std::right << std::setw(12) << "count" << std::setw(10)
+            << "ns/op" << std::setw(12) << "cycles/op" << std::setw(12) << "instr/op" << std::setw(8) << "IPC"
+            << std::setw(12) << "L1D-miss/op" << std::setw(12) << "LLC-miss/op" << std::setw(12) << "br-miss/op"
+            << '\n';
+        out << std::fixed << std::setprecision(2);
+        for (std::size_t operation = 0; operation < kOperationCount; ++operation)
+        {
+            const PerfStats& stats = stats_[operation];
+            const double count = stats.count == 0 ? 1.0 : static_cast<double>(stats.count);
+            out << std::left << std::setw(10) << kOperationNames[operation] << std::right << std::setw(12)
+                << stats.count << std::setw(10) << static_cast<double>(stats.total_nanoseconds) / count;
+            const auto perOperation = [&](PerfEvent event, int width) {
+                if (counters_.Available(event))
+                {
+                    const auto total = stats.totals[static_cast<std::size_t>(event)];
+                    out << std::setw(width) << static_cast<double>(total) / count;
+                }
+                else
+                {
+                    out << std::setw(width) << "-";
+                }
+            };
+            perOperation(PerfEvent::CYCLES, 12);
+            perOperation(PerfEvent::INSTRUCTIONS, 12);
+            const auto cycles = stats.totals[static_cast<std::size_t>(PerfEvent::CYCLES)];
+            if (counters_.Available(PerfEvent::CYCLES) && counters_.Available(PerfEvent::INSTRUCTIONS) && cycles > 0)
+            {
+                out << std::setw(8)
+                    << static_cast<double>(stats.totals[static_cast<std::size_t>(PerfEvent::INSTRUCTIONS)]) /
+                           static_cast<double>(cycles);
+            }
+            else
+            {
+                out << std::setw(8) << "-";
+            }
+            perOperation(PerfEvent::L1D_MISSES, 12);
+            perOperation(PerfEvent::LLC_MISSES, 12);
+            perOperation(PerfEvent::BRANCH_MISSES, 12);
+            out << '\n';
+        }
+        out.flags(flags);
+        out.precision(precision);
+
+        for (std::size_t operation = 0; operation < kOperationCount; ++operation)
+        {
+            const PerfStats& stats = stats_[operation];
+            if (stats.count == 0)
+            {
+                continue;
+            }
+            out << '\n' << kOperationNames[operation] << " latency (ns)\n";
+            for (std::size_t bucket = 0; bucket < PerfStats::kHistogramBuckets; ++bucket)
+            {
+                if (stats.latency_histogram[bucket] == 0)
+                {
+                    continue;
+                }
+                const std::uint64_t low = bucket == 0 ? 0 : std::uint64_t{1} << (bucket - 1);
+                out << "  [" << std::setw(10) << low << ", " << std::setw(10) << (std::uint64_t{1} << bucket)
+                    << ") " << std::setw(12) << stats.latency_histogram[bucket] << '\n';
+            }
+        }
+    }
+
+  private:
+    friend class PerfScope;
+    static constexpr std::size_t kOperationCount = static_cast<std::size_t>(PerfOperation::COUNT);
+
+    PerfProfiler() = default;
+
+    void record(PerfOperation operation, const PerfCounters::Sample& begin, const PerfCounters::Sample& end,
+                std::uint64_t nanoseconds)
+    {
+        PerfStats& stats = stats_[static_cast<std::size_t>(operation)];
+        ++stats.count;
+        for (std::size_t event = 0; event < PerfCounters::kEventCount; ++event)
+        {
+            stats.totals[event] += end[event] - begin[event];
+        }
+        stats.total_nanoseconds += nanoseconds;
+        const auto bucket = static_cast<std::size_t>(std::bit_width(nanoseconds));
+        ++stats.latency_histogram[bucket < PerfStats::kHistogramBuckets ? bucket : PerfStats::kHistogramBuckets - 1];
+    }
+
+    PerfCounters counters_;
+    std::array<PerfStats, kOperationCount> stats_{};
+    // Number of PerfScopes alive on this thread, only the outermost one records so that an operation implemented
+    // with other instrumented operations (a Map wrapping its tree) is counted once
+    std::size_t depth_ = 0;
+};
+
+// Measures the enclosing operation
+class PerfScope
+{
+  public:
+    explicit PerfScope(PerfOperation operation)
+        : operation_(operation), profiler_(PerfProfiler::ThisThread()), outermost_(profiler_.depth_++ == 0)
+    {
+        // The counters are read outside of the timed interval on both ends, so their read syscalls don't add to the
+        // latency
+        if (outermost_)
+        {
+            start_ = profiler_.counters_.Read();
+            start_time_ = std::chrono::steady_clock::now();
+        }
+    }
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+    ~PerfScope()
+    {
+        if (outermost_)
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - start_time_;
+            const PerfCounters::Sample end = profiler_.counters_.Read();
+            profiler_.record(operation_, start_, end,
+                             static_cast<std::uint64_t>(
+                                 std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+        --profiler_.depth_;
+    }
+
+  private:
+    PerfOperation operation_;
+    PerfProfiler& profiler_;
+    bool outermost_;
+    std::chrono::steady_clock::time_point start_time_;
+    PerfCounters::Sample start_{};
+};
+
+#define MAP_PERF_SCOPE(operation) const PerfScope map_perf_scope_(PerfOperation::operation)
+
+#else
+
+#define MAP_PERF_SCOPE(operation)
+
+#endif // MAP_PERF_COUNTERS
+
+#endif // MAP_PERF_COUNTERS_H
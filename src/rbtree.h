@@ -1,47 +1,94 @@
 #ifndef RB_MAP_TREE_H
 #define RB_MAP_TREE_H
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
 #include <concepts>
+#include <cstddef>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+
+#include "perf_counters.h"
+
+// Key types ordered like the bytes of the std::string_view they convert to. Lookups compare them skipping the prefix
+// known to be shared, see RBTree::PathComparator.
+template <class KeyType> inline constexpr bool kOrderedAsString = std::is_same_v<KeyType, std::string>;
 
 template <std::totally_ordered KeyType, class ValueType> class RBTree
 {
-  private:
+  public:
     using value_type = std::pair<KeyType, ValueType>;
 
+  private:
+    // Whether an argument can be used to look up a key without constructing a KeyType first
+    template <typename Arg> static constexpr bool kIsKey = std::is_same_v<std::remove_cvref_t<Arg>, KeyType>;
+
+  private:
+    struct RBTreeNode;
+    // Frees a node unless Compact() placed it in "arena_", whose memory is released in one piece
+    struct NodeDeleter
+    {
+        void operator()(RBTreeNode* node) const
+        {
+            if (node->arena_allocated)
+            {
+                std::destroy_at(node);
+            }
+            else
+            {
+                delete node;
+            }
+        }
+    };
+    using NodePtr = std::unique_ptr<RBTreeNode, NodeDeleter>;
+
     struct RBTreeNode
     {
-        value_type node_value;
-        const KeyType& key = node_value.first;
-        RBTreeNode* parent = nullptr;
+        // Held in a union so that "end_node_" doesn't need to construct an element, which also means neither KeyType
+        // nor ValueType has to be default constructible
+        union
+        {
+            value_type node_value;
+        };
+        // The flags come first so that they fill the padding after the element rather than adding their own
         enum class Color : bool
         {
             RED,
             BLACK
         } color = Color::BLACK;
-        std::unique_ptr<RBTreeNode> left_child;
-        std::unique_ptr<RBTreeNode> right_child;
-        RBTreeNode() = default;
-        RBTreeNode(const KeyType& key, const ValueType& value)
+        bool has_value = false;
+        bool arena_allocated = false;
+        RBTreeNode* parent = nullptr;
+        NodePtr left_child;
+        NodePtr right_child;
+        RBTreeNode()
         {
-            node_value.first = key;
-            node_value.second = value;
         }
-        RBTreeNode(KeyType&& key, ValueType&& value)
+        // Constructs the element in place from "args"
+        template <typename... Args>
+        explicit RBTreeNode(std::in_place_t, Args&&... args) : node_value(std::forward<Args>(args)...), has_value(true)
         {
-            node_value.first = std::move(key);
-            node_value.second = std::move(value);
         }
-        RBTreeNode(const KeyType& key, ValueType&& value)
+        RBTreeNode(const RBTreeNode&) = delete;
+        RBTreeNode& operator=(const RBTreeNode&) = delete;
+        ~RBTreeNode()
         {
-            node_value.first = key;
-            node_value.second = std::move(value);
+            if (has_value)
+            {
+                node_value.~value_type();
+            }
         }
-        RBTreeNode(KeyType&& key, const ValueType& value)
+        [[nodiscard]] const KeyType& key() const
         {
-            node_value.first = std::move(key);
-            node_value.second = value;
+            return node_value.first;
         }
         [[nodiscard]] bool IsLeftChild() const
         {
@@ -49,6 +96,109 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
         }
     };
 
+    // Raw storage for the nodes Compact() relocates. It only owns the memory, the nodes living in it are still owned
+    // by their parents and get destroyed through NodeDeleter.
+    class NodeArena
+    {
+      public:
+        NodeArena() = default;
+        explicit NodeArena(std::size_t capacity)
+            : nodes_(std::allocator<RBTreeNode>().allocate(capacity)), capacity_(capacity)
+        {
+        }
+        NodeArena(NodeArena&& other) noexcept
+            : nodes_(std::exchange(other.nodes_, nullptr)), capacity_(std::exchange(other.capacity_, 0))
+        {
+        }
+        NodeArena& operator=(NodeArena&& other) noexcept
+        {
+            NodeArena released(std::move(other));
+            std::swap(nodes_, released.nodes_);
+            std::swap(capacity_, released.capacity_);
+            return *this;
+        }
+        ~NodeArena()
+        {
+            if (nodes_ != nullptr)
+            {
+                std::allocator<RBTreeNode>().deallocate(nodes_, capacity_);
+            }
+        }
+        [[nodiscard]] RBTreeNode* Slot(std::size_t index) const
+        {
+            assert(index < capacity_);
+            return nodes_ + index;
+        }
+
+      private:
+        RBTreeNode* nodes_ = nullptr;
+        std::size_t capacity_ = 0;
+    };
+
+    // Compares a search key against the keys met on one root-to-leaf path. For string keys it skips the prefix known to
+    // be shared: every key in the subtree being descended into lies between the nearest ancestors the path turned left
+    // and right at, so it shares with the search key at least the shorter of the search key's common prefixes with
+    // those two ancestors. Long keys with shared prefixes, like paths or metric names, are then compared mostly once.
+    class PathComparator
+    {
+        static constexpr bool kSkipsPrefix = kOrderedAsString<KeyType>;
+
+      public:
+        // Returns a negative value if "key" orders before "node_key", zero if they are equal and a positive value
+        // otherwise. Each call has to be made on the child the previous result leads to.
+        int Compare(const KeyType& key, const KeyType& node_key)
+        {
+            if constexpr (kSkipsPrefix)
+            {
+                const std::string_view bytes(key);
+                const std::string_view node_bytes(node_key);
+                const std::size_t length = std::min(bytes.size(), node_bytes.size());
+                const std::size_t offset = std::min({low_prefix_, high_prefix_, length});
+                const auto mismatch =
+                    std::mismatch(bytes.data() + offset, bytes.data() + length, node_bytes.data() + offset).first;
+                const auto common_prefix = static_cast<std::size_t>(mismatch - bytes.data());
+                int result;
+                if (common_prefix == length)
+                {
+                    result = bytes.size() < node_bytes.size() ? -1 : (bytes.size() > node_bytes.size() ? 1 : 0);
+                }
+                else
+                {
+                    using traits_type = std::string_view::traits_type;
+                    result = traits_type::lt(bytes[common_prefix], node_bytes[common_prefix]) ? -1 : 1;
+                }
+                // An equal key ends a Find but is an upper bound a lower bound search keeps descending below
+                (result <= 0 ? high_prefix_ : low_prefix_) = common_prefix;
+                return result;
+            }
+            else
+            {
+                if (key == node_key)
+                {
+                    return 0;
+                }
+                return node_key > key ? -1 : 1;
+            }
+        }
+        // Whether "node_key" orders before "key", with the same rules as Compare
+        bool NodeLess(const KeyType& key, const KeyType& node_key)
+        {
+            if constexpr (kSkipsPrefix)
+            {
+                return Compare(key, node_key) > 0;
+            }
+            else
+            {
+                return node_key < key;
+            }
+        }
+
+      private:
+        // Common prefix of the search key with the nearest ancestor smaller, respectively greater, than it
+        std::size_t low_prefix_ = 0;
+        std::size_t high_prefix_ = 0;
+    };
+
   public:
     class TreeIterator
     {
@@ -94,22 +244,26 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
 
         TreeIterator& operator++()
         {
+            MAP_PERF_SCOPE(ITERATE);
             this->node_ptr_ = RBTree::next(node_ptr_);
             return (*this);
         }
         TreeIterator& operator--()
         {
+            MAP_PERF_SCOPE(ITERATE);
             this->node_ptr_ = RBTree::previous(node_ptr_);
             return (*this);
         }
         TreeIterator operator++(int)
         {
+            MAP_PERF_SCOPE(ITERATE);
             auto temp(*this);
             this->node_ptr_ = RBTree::next(node_ptr_);
             return temp;
         }
         TreeIterator operator--(int)
         {
+            MAP_PERF_SCOPE(ITERATE);
             auto temp(*this);
             this->node_ptr_ = RBTree::previous(node_ptr_);
             return temp;
@@ -126,7 +280,285 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
 
     using iterator = TreeIterator;
 
+    // Forward cursor over the half-open key interval [lo, hi). The cursor keeps the next "kPrefetchDistance" nodes of
+    // the successor chain resolved and prefetched, so the cache misses on their elements overlap with the work done on
+    // the nodes in front of them. The links the successor walk follows are prefetched ahead of it by scouts, see
+    // advanceScouts(). tools/bench_range_cursor compares the cursor with plain iteration.
+    class RangeCursor
+    {
+      public:
+        static constexpr std::size_t kPrefetchDistance = 8;
+        static constexpr std::size_t kScoutCount = 4;
+
+      public:
+        RangeCursor() = default;
+
+        [[nodiscard]] bool Done() const
+        {
+            return count_ == 0;
+        }
+
+        value_type& operator*() const
+        {
+            assert(!Done());
+            return window_[head_]->node_value;
+        }
+        value_type* operator->() const
+        {
+            assert(!Done());
+            return &(window_[head_]->node_value);
+        }
+
+        RangeCursor& operator++()
+        {
+            MAP_PERF_SCOPE(ITERATE);
+            assert(!Done());
+            head_ = (head_ + 1) % kPrefetchDistance;
+            --count_;
+            advanceScouts();
+            extend();
+            return *this;
+        }
+
+        // Visits at most "max_count" elements and returns how many were visited
+        template <typename Visitor> std::size_t VisitBatch(std::size_t max_count, Visitor&& visitor)
+        {
+            std::size_t visited = 0;
+            for (; visited < max_count && !Done(); ++visited)
+            {
+                visitor(**this);
+                ++(*this);
+            }
+            return visited;
+        }
+
+        // Copies the next elements of the range into "out" and returns how many were copied. A return value smaller
+        // than out.size() means the range is exhausted.
+        std::size_t Fill(std::span<value_type> out)
+        {
+            return VisitBatch(out.size(), [out, i = std::size_t{0}](const value_type& element) mutable {
+                out[i++] = element;
+            });
+        }
+
+      private:
+        friend class RBTree;
+
+        RangeCursor(RBTreeNode* first, RBTreeNode* stop) : stop_(stop)
+        {
+            if (first == stop)
+            {
+                return;
+            }
+            push(first);
+            while (count_ < kPrefetchDistance && extend())
+            {
+            }
+        }
+
+        void push(RBTreeNode* node)
+        {
+            RBTree::prefetchNode(node);
+            if (node->right_child)
+            {
+                RBTree::prefetchLinks(node->right_child.get());
+            }
+            window_[(head_ + count_) % kPrefetchDistance] = node;
+            ++count_;
+            tail_ = node;
+        }
+
+        // Resolves the successor of the last node in the window. The last node was prefetched when it entered the
+        // window and the left spines the walk descends were scouted, so following the links is usually a cache hit.
+        bool extend()
+        {
+            if (tail_ == nullptr)
+            {
+                return false;
+            }
+            RBTreeNode* successor;
+            if (tail_->right_child)
+            {
+                successor = tail_->right_child.get();
+                while (successor->left_child)
+                {
+                    pushAncestor(successor);
+                    successor = successor->left_child.get();
+                }
+            }
+            else if (ancestor_count_ > 0)
+            {
+                successor = ancestors_[--ancestor_count_].node;
+            }
+            else
+            {
+                // The ancestors left behind before the cursor started or pushed out of "ancestors_"
+                successor = RBTree::next(tail_);
+            }
+            if (successor == stop_)
+            {
+                tail_ = nullptr;
+                return false;
+            }
+            push(successor);
+            return true;
+        }
+
+        // "node" is visited once the walk comes back up from its left subtree, after which it descends the left spine
+        // of its right subtree
+        void pushAncestor(RBTreeNode* node)
+        {
+            if (ancestor_count_ == kScoutCount)
+            {
+                // Only the innermost ancestors are scouted, the outermost one is found again by climbing
+                std::move(ancestors_.begin() + 1, ancestors_.end(), ancestors_.begin());
+                --ancestor_count_;
+            }
+            const RBTreeNode* const right_child = node->right_child.get();
+            if (right_child)
+            {
+                RBTree::prefetchLinks(right_child);
+            }
+            ancestors_[ancestor_count_++] = {node, right_child};
+        }
+
+        // The successor walk is a chain of dependent loads, prefetching only its next hop hides little. Each step
+        // advances one prefetched hop down the left spine the walk enters after every pending ancestor, so the
+        // spines are loaded in parallel well before the walk reaches them.
+        void advanceScouts()
+        {
+            for (std::size_t i = 0; i < ancestor_count_; ++i)
+            {
+                const RBTreeNode*& scout = ancestors_[i].scout;
+                if (scout && scout->left_child)
+                {
+                    scout = scout->left_child.get();
+                    RBTree::prefetchLinks(scout);
+                }
+            }
+        }
+
+        // Ancestor of the window's last node that the walk comes back up to, with the deepest node of the left spine
+        // of its right subtree prefetched so far
+        struct Ancestor
+        {
+            RBTreeNode* node;
+            const RBTreeNode* scout;
+        };
+
+        std::array<RBTreeNode*, kPrefetchDistance> window_{};
+        std::size_t head_ = 0;
+        std::size_t count_ = 0;
+        RBTreeNode* tail_ = nullptr; // Last node pushed into the window, nullptr once the range is exhausted
+        RBTreeNode* stop_ = nullptr; // First node past the range
+        std::array<Ancestor, kScoutCount> ancestors_{}; // Innermost last
+        std::size_t ancestor_count_ = 0;
+    };
+
+    // Remembers where the previous lookup landed and starts the next one from there, see LowerBound(finger, key).
+    // Sequences of nearby lookups, like a sliding window or a merge-join against another sorted sequence, then mostly
+    // cost O(log d) for a distance d between consecutive keys. Erasing the element the cursor rests on invalidates it
+    // until the next Reset().
+    class FingerCursor
+    {
+      public:
+        explicit FingerCursor(RBTree& tree) : tree_(&tree), finger_(tree.end())
+        {
+        }
+
+        iterator LowerBound(const KeyType& key)
+        {
+            const iterator result = tree_->LowerBound(finger_, key);
+            // Past the last element there is nothing left to climb from, keep the previous finger instead
+            if (result != tree_->end())
+            {
+                finger_ = result;
+            }
+            return result;
+        }
+        iterator Find(const KeyType& key)
+        {
+            const iterator result = LowerBound(key);
+            if (result != tree_->end() && result->first == key)
+            {
+                return result;
+            }
+            return tree_->end();
+        }
+
+        // Forgets the finger, the next lookup descends from the root
+        void Reset()
+        {
+            finger_ = tree_->end();
+        }
+
+      private:
+        RBTree* tree_;
+        iterator finger_;
+    };
+
   public:
+    RBTree() = default;
+
+    // Copies the tree node for node, keeping its shape and colors, so no comparisons or rebalancing are needed
+    RBTree(const RBTree& other)
+        requires std::is_copy_constructible_v<value_type>
+    {
+        if (other.end_node_.left_child)
+        {
+            end_node_.left_child = cloneSubtree(other.end_node_.left_child.get(), &end_node_);
+            min_node_ptr_ = leftMost(end_node_.left_child.get());
+        }
+        size_ = other.size_;
+    }
+
+    RBTree& operator=(const RBTree& other)
+        requires std::is_copy_constructible_v<value_type>
+    {
+        RBTree copy(other);
+        Swap(copy);
+        return *this;
+    }
+
+    // Moving only hands over the root, no node is touched other than the root whose parent is the sentinel
+    RBTree(RBTree&& other) noexcept
+    {
+        Swap(other);
+    }
+
+    RBTree& operator=(RBTree&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Clear();
+            Swap(other);
+        }
+        return *this;
+    }
+
+    // Exchanges the contents of two trees in O(1). Iterators other than end() keep pointing to the same elements.
+    void Swap(RBTree& other) noexcept
+    {
+        end_node_.left_child.swap(other.end_node_.left_child);
+        if (end_node_.left_child)
+        {
+            end_node_.left_child->parent = &end_node_;
+        }
+        if (other.end_node_.left_child)
+        {
+            other.end_node_.left_child->parent = &other.end_node_;
+        }
+        std::swap(arena_, other.arena_);
+        std::swap(min_node_ptr_, other.min_node_ptr_);
+        std::swap(size_, other.size_);
+    }
+
+    [[nodiscard]] RBTree Clone() const
+        requires std::is_copy_constructible_v<value_type>
+    {
+        return RBTree(*this);
+    }
+
     [[nodiscard]] std::size_t Size() const
     {
         return size_;
@@ -134,8 +566,9 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
 
     std::pair<iterator, bool> Insert(const value_type& element)
     {
-        const auto parent = getParent(element.first);
-        if (parent == nullptr)
+        MAP_PERF_SCOPE(INSERT);
+        const auto [parent, result] = getParent(element.first);
+        if (result == false)
         {
             return {iterator(parent), false};
         }
@@ -145,6 +578,7 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
 
     std::pair<iterator, bool> Insert(value_type&& element)
     {
+        MAP_PERF_SCOPE(INSERT);
         const auto [parent, result] = getParent(element.first);
         if (result == false)
         {
@@ -154,23 +588,83 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
         return insertInternal(parent, getNewNode(parent, std::move(element)));
     }
 
-    template <typename First, typename Second> std::pair<iterator, bool> Emplace(First&& first, Second&& second)
+    // Emplace(key, value) with a KeyType key: the key is looked up first, so nothing is allocated or constructed if
+    // it's already present, otherwise the value is constructed in place from "value"
+    template <typename Key, typename Value>
+        requires kIsKey<Key>
+    std::pair<iterator, bool> Emplace(Key&& key, Value&& value)
     {
-        static_assert(std::is_same_v<typename std::remove_const_t<std::remove_reference_t<First>>, KeyType>);
-        static_assert(std::is_same_v<typename std::remove_const_t<std::remove_reference_t<Second>>, ValueType>);
+        MAP_PERF_SCOPE(INSERT);
+        return tryEmplace(std::forward<Key>(key), std::forward<Value>(value));
+    }
 
-        const auto [parent, result] = getParent(first);
-        if (result == false)
+    // Emplace(std::piecewise_construct, key_args, value_args): if "key_args" is a single KeyType the key is looked up
+    // before anything is constructed, like TryEmplace
+    template <typename... KeyArgs, typename... ValueArgs>
+    std::pair<iterator, bool> Emplace(std::piecewise_construct_t, std::tuple<KeyArgs...> key_args,
+                                      std::tuple<ValueArgs...> value_args)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        if constexpr (sizeof...(KeyArgs) == 1 && (kIsKey<KeyArgs> && ...))
         {
-            return {iterator(parent), false};
+            const auto [parent, result] = getParent(std::get<0>(key_args));
+            if (result == false)
+            {
+                return {iterator(parent), false};
+            }
+            return insertInternal(parent, getNewNode(parent, std::piecewise_construct, std::move(key_args),
+                                                     std::move(value_args)));
+        }
+        else
+        {
+            return emplaceNode(
+                getNewNode(nullptr, std::piecewise_construct, std::move(key_args), std::move(value_args)));
         }
+    }
 
-        return insertInternal(parent, getNewNode(parent, std::forward<First>(first), std::forward<Second>(second)));
+    // Any other arguments have to construct the element before its key is known
+    template <typename... Args> std::pair<iterator, bool> Emplace(Args&&... args)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        return emplaceNode(getNewNode(nullptr, std::forward<Args>(args)...));
+    }
+
+    // Inserts an element with key "key" and a value constructed in place from "args", unless "key" is already present
+    // in which case nothing is allocated and "args" are left untouched
+    template <typename... Args> std::pair<iterator, bool> TryEmplace(const KeyType& key, Args&&... args)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        return tryEmplace(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args> std::pair<iterator, bool> TryEmplace(KeyType&& key, Args&&... args)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        return tryEmplace(std::move(key), std::forward<Args>(args)...);
     }
 
+    // Assigns "value" to the element with key "key" if there is one, otherwise inserts a new element constructed from
+    // "key" and "value". The bool is true if an insertion took place.
+    template <typename Key, typename Value>
+        requires kIsKey<Key>
+    std::pair<iterator, bool> InsertOrAssign(Key&& key, Value&& value)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        const auto [node, result] = getParent(key);
+        if (result == false)
+        {
+            node->node_value.second = std::forward<Value>(value);
+            return {iterator(node), false};
+        }
+        return insertInternal(node, getNewNode(node, std::piecewise_construct,
+                                               std::forward_as_tuple(std::forward<Key>(key)),
+                                               std::forward_as_tuple(std::forward<Value>(value))));
+    }
+
+    // Removes the element pointed to by "to_delete" and returns an iterator to the element that followed it
     iterator Erase(iterator to_delete)
     {
-        auto getOwningPointer = [](const RBTreeNode* node) -> std::unique_ptr<RBTreeNode>& {
+        MAP_PERF_SCOPE(ERASE);
+        auto getOwningPointer = [](const RBTreeNode* node) -> NodePtr& {
             if (node->IsLeftChild())
             {
                 return node->parent->left_child;
@@ -182,127 +676,270 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
         };
 
         RBTreeNode* const node_to_delete = to_delete.GetUnderlyingNodePtr(); // Node to delete
-        bool update_min_node_ptr = false;
-        if (to_delete->first == min_node_ptr_->key)
+        RBTreeNode* const successor = next(node_to_delete);
+        if (node_to_delete == min_node_ptr_)
         {
-            update_min_node_ptr = true;
+            min_node_ptr_ = successor == &end_node_ ? nullptr : successor;
         }
 
-        RBTreeNode* parent = node_to_delete->parent;
+        // "x" is the node that moves into the position vacated in the tree (possibly nullptr) and "x_parent" is its
+        // parent. If the node removed from that position was BLACK, the path through "x" is now one BLACK node short.
+        RBTreeNode* x = nullptr;
+        RBTreeNode* x_parent = nullptr;
+        auto removed_color = node_to_delete->color;
+        // Will delete "node_to_delete" when this goes out of scope
+        NodePtr temporary_owner;
+
         // There are 3 cases:
-        //      1) "node_to_delete" has only right child
-        //      2) "node_to_delete" has only left child
+        //      1) "node_to_delete" has no left child
+        //      2) "node_to_delete" has no right child
         //      3) "node_to_delete" has both children
-        // The first two cases are symmetrical, and we handle them first
-        if (node_to_delete->left_child == nullptr)
+        // The first two cases are symmetrical, the only child (if any) takes up the place of the deleted node
+        if (node_to_delete->left_child == nullptr || node_to_delete->right_child == nullptr)
         {
-            // Case 1
-            // "node_to_delete" has only right child, the right child takes up the place of the now deleted node
-            std::unique_ptr<RBTreeNode>& owning_ptr = getOwningPointer(node_to_delete);
-
-            // Will get deleted when this goes out of scope
-            std::unique_ptr<RBTreeNode> temporary_owner(owning_ptr.release());
-            owning_ptr = std::move(temporary_owner->right_child);
-            if (owning_ptr)
-                owning_ptr->parent = parent;
-            if (update_min_node_ptr)
-                min_node_ptr_ = owning_ptr.get();
-            if (temporary_owner->color == RBTreeNode::Color::BLACK)
+            NodePtr& owning_ptr = getOwningPointer(node_to_delete);
+            temporary_owner = std::move(owning_ptr);
+            if (temporary_owner->left_child)
             {
-                // If the node being deleted was BLACK then we have broken the RBTree properties invariance
-                deleteFixup(owning_ptr.get());
+                owning_ptr = std::move(temporary_owner->left_child);
             }
-            return TreeIterator(owning_ptr.get());
-        }
-        else if (node_to_delete->right_child == nullptr)
-        {
-            // Case 2
-            std::unique_ptr<RBTreeNode>& owning_ptr = getOwningPointer(node_to_delete);
-
-            // Will get deleted when this goes out of scope
-            std::unique_ptr<RBTreeNode> temporary_owner(owning_ptr.release());
-            owning_ptr = std::move(temporary_owner->left_child);
-            owning_ptr->parent = parent;
-            if (update_min_node_ptr)
-                min_node_ptr_ = owning_ptr.get();
-            if (temporary_owner->color == RBTreeNode::Color::BLACK)
+            else
+            {
+                owning_ptr = std::move(temporary_owner->right_child);
+            }
+            x = owning_ptr.get();
+            x_parent = temporary_owner->parent;
+            if (x)
             {
-                // If the node being deleted was BLACK then we have broken the RBTree properties invariance
-                deleteFixup(owning_ptr.get());
+                x->parent = x_parent;
             }
-            return TreeIterator(owning_ptr.get());
         }
         else
         {
             // Case 3
-            auto successor = leftMost(node_to_delete->right_child.get());
+            // The successor is the leftmost node of the right subtree, it is unlinked from its current position and
+            // takes up the place and the color of the deleted node
             assert(successor->left_child == nullptr);
-            auto const successor_color = successor->color;
-            // There are two possibilities, the successor's parent could be the node that's going to be deleted or not.
+            removed_color = successor->color;
+            NodePtr& successor_owning_ptr = getOwningPointer(successor);
+            NodePtr successor_temporary_owner = std::move(successor_owning_ptr);
             if (successor->parent == node_to_delete)
             {
-                std::unique_ptr<RBTreeNode>& deletion_node_owning_ptr = getOwningPointer(node_to_delete);
-                std::unique_ptr<RBTreeNode> deletion_node_temporary_owner(deletion_node_owning_ptr.release());
-                deletion_node_owning_ptr = std::move(deletion_node_temporary_owner->right_child);
-                deletion_node_owning_ptr->left_child = std::move(deletion_node_temporary_owner->left_child);
-                deletion_node_owning_ptr->parent = parent;
-                deletion_node_owning_ptr->color = deletion_node_temporary_owner->color;
-                deletion_node_owning_ptr->left_child->parent = deletion_node_owning_ptr.get();
-                if (update_min_node_ptr)
-                    min_node_ptr_ = deletion_node_owning_ptr.get();
-                if (successor_color == RBTreeNode::Color::BLACK)
+                // The successor keeps its right subtree
+                x = successor->right_child.get();
+                x_parent = successor;
+            }
+            else
+            {
+                successor_owning_ptr = std::move(successor->right_child);
+                x = successor_owning_ptr.get();
+                x_parent = successor->parent;
+                if (x)
                 {
-                    deleteFixup(deletion_node_owning_ptr->right_child.get());
+                    x->parent = x_parent;
                 }
-                return TreeIterator(deletion_node_owning_ptr.get());
+                successor->right_child = std::move(node_to_delete->right_child);
+                successor->right_child->parent = successor;
             }
-            else
+            successor->left_child = std::move(node_to_delete->left_child);
+            successor->left_child->parent = successor;
+            successor->color = node_to_delete->color;
+
+            NodePtr& owning_ptr = getOwningPointer(node_to_delete);
+            temporary_owner = std::move(owning_ptr);
+            owning_ptr = std::move(successor_temporary_owner);
+            successor->parent = temporary_owner->parent;
+        }
+        assert(temporary_owner->left_child == nullptr);
+        assert(temporary_owner->right_child == nullptr);
+
+        if (removed_color == RBTreeNode::Color::BLACK)
+        {
+            // If the node being deleted was BLACK then we have broken the RBTree properties invariance
+            deleteFixup(x, x_parent);
+        }
+        --size_;
+        return iterator(successor);
+    }
+
+    // Returns an iterator to the element with key "key", or end() if there is no such element
+    iterator Find(const KeyType& key)
+    {
+        MAP_PERF_SCOPE(FIND);
+        const auto [node, absent] = getParent(key);
+        if (absent)
+        {
+            return end();
+        }
+        return iterator(node);
+    }
+
+    // Looks up every key in "keys" and stores in out[i] the result of Find(keys[i]). Up to "kInterleave" descents are
+    // kept in flight: each step moves every pending descent one level down and prefetches the child it visits next, so
+    // the cache misses of different keys overlap instead of being serialized.
+    template <std::size_t kInterleave = 16> void FindMany(std::span<const KeyType> keys, std::span<iterator> out)
+    {
+        static_assert(kInterleave > 0);
+        assert(out.size() >= keys.size());
+
+        struct Descent
+        {
+            RBTreeNode* node;
+            std::size_t index; // Index into "keys" and "out"
+            PathComparator comparator;
+        };
+        std::array<Descent, kInterleave> descents;
+        RBTreeNode* const root = end_node_.left_child.get();
+        std::size_t in_flight = 0;
+        std::size_t next_key = 0;
+        while (in_flight < kInterleave && next_key < keys.size())
+        {
+            descents[in_flight++] = {root, next_key++, {}};
+        }
+
+        while (in_flight > 0)
+        {
+            for (std::size_t i = 0; i < in_flight;)
             {
-                auto successor_parent = successor->parent;
-                std::unique_ptr<RBTreeNode> successor_temp_owner;
-                std::unique_ptr<RBTreeNode>& successor_current_owner = getOwningPointer(successor);
-                successor_current_owner.swap(successor_temp_owner);
-                // At this stage the successor is owned by the local unique_ptr -> "successor_temp_owner"
-                successor_current_owner = std::move(successor_temp_owner->right_child);
-                if (successor_current_owner)
+                Descent& descent = descents[i];
+                const KeyType& key = keys[descent.index];
+                RBTreeNode* const node = descent.node;
+                const int order = node ? descent.comparator.Compare(key, node->key()) : 0;
+                if (order != 0)
                 {
-                    successor_current_owner->parent = successor_parent;
+                    descent.node = order < 0 ? node->left_child.get() : node->right_child.get();
+                    if (descent.node)
+                    {
+                        prefetchNode(descent.node);
+                    }
+                    ++i;
+                    continue;
                 }
 
-                assert(successor_temp_owner->left_child ==
-                       nullptr); // Is null because it's the leftmost node in it;s subtree
-                assert(successor_temp_owner->right_child ==
-                       nullptr); // Is null because we have moved the right subtree to the location that the successor
-                                 // previous occupied in the tree
-
-                std::unique_ptr<RBTreeNode>& deletion_node_owning_ptr = getOwningPointer(node_to_delete);
-                std::unique_ptr<RBTreeNode> deletion_node_temporary_owner(deletion_node_owning_ptr.release());
-                deletion_node_owning_ptr = std::move(successor_temp_owner);
-                deletion_node_owning_ptr->left_child = std::move(deletion_node_temporary_owner->left_child);
-                deletion_node_owning_ptr->left_child->parent = deletion_node_owning_ptr.get();
-
-                deletion_node_owning_ptr->right_child = std::move(deletion_node_temporary_owner->right_child);
-                deletion_node_owning_ptr->right_child->parent = deletion_node_owning_ptr.get();
-                deletion_node_owning_ptr->color = deletion_node_temporary_owner->color;
-                deletion_node_owning_ptr->parent = parent;
-                // When deletion_node_temporary_owner goes out of scope we would have deleted the node that we were
-                // intending on deleting
-                assert(deletion_node_temporary_owner->left_child == nullptr);
-                assert(deletion_node_temporary_owner->right_child == nullptr);
-                if (update_min_node_ptr)
-                    min_node_ptr_ = deletion_node_owning_ptr.get();
-                if (successor_color == RBTreeNode::Color::BLACK)
+                // This descent is finished, reuse its slot for the next key or retire it
+                out[descent.index] = node ? iterator(node) : end();
+                if (next_key < keys.size())
+                {
+                    descent = {root, next_key++, {}};
+                    ++i;
+                }
+                else
                 {
-                    deleteFixup(successor_current_owner.get());
+                    descent = descents[--in_flight];
                 }
-                return TreeIterator(deletion_node_owning_ptr.get());
             }
         }
     }
 
+    // Returns an iterator to the first element whose key is not less than "key", or end() if there is no such element
+    iterator LowerBound(const KeyType& key)
+    {
+        MAP_PERF_SCOPE(FIND);
+        return iterator(lowerBound(key));
+    }
+
+    // Same as LowerBound(key), but the search starts from the element "finger" points to: it climbs through the parent
+    // links only until it reaches a subtree that holds "key", then descends from there. The cost is twice the height of
+    // that subtree, which for a key d elements away from the finger is typically O(log d), only keys on both sides of
+    // a high node pay up to a full descent. Looking up n sorted keys that are dense in the tree, each from the previous
+    // result, costs O(n) in total rather than O(n log N). An end() finger searches from the root.
+    iterator LowerBound(iterator finger, const KeyType& key)
+    {
+        MAP_PERF_SCOPE(FIND);
+        return iterator(lowerBound(finger.GetUnderlyingNodePtr(), key));
+    }
+
+    // Same as Find(key), starting from "finger" like LowerBound(finger, key)
+    iterator Find(iterator finger, const KeyType& key)
+    {
+        MAP_PERF_SCOPE(FIND);
+        RBTreeNode* const node = lowerBound(finger.GetUnderlyingNodePtr(), key);
+        if (node == &end_node_ || !(node->key() == key))
+        {
+            return end();
+        }
+        return iterator(node);
+    }
+
+    // Returns a cursor over the elements whose keys lie in [lo, hi)
+    RangeCursor Range(const KeyType& lo, const KeyType& hi)
+    {
+        if (!(lo < hi))
+        {
+            return RangeCursor();
+        }
+        return RangeCursor(lowerBound(lo), lowerBound(hi));
+    }
+
+    // Calls "visitor" on every element whose key lies in [lo, hi) in key order, returns the number of elements visited
+    template <typename Visitor> std::size_t Scan(const KeyType& lo, const KeyType& hi, Visitor&& visitor)
+    {
+        std::size_t visited = 0;
+        for (auto cursor = Range(lo, hi); !cursor.Done(); ++cursor)
+        {
+            visitor(*cursor);
+            ++visited;
+        }
+        return visited;
+    }
+
+    // Removes all elements
+    void Clear()
+    {
+        end_node_.left_child.reset();
+        arena_ = NodeArena();
+        min_node_ptr_ = nullptr;
+        size_ = 0;
+    }
+
+    // Moves every node into one freshly allocated block, in key order, so that scans walk memory sequentially and
+    // lookups touch far fewer cache lines than in a tree scattered across the heap by insert/erase churn. Elements are
+    // moved, not copied, and the tree stays fully mutable: later insertions allocate as usual and erased nodes leave a
+    // hole in the block until the next Compact(). Invalidates all iterators.
+    void Compact()
+        requires std::is_nothrow_move_constructible_v<value_type>
+    {
+        if (size_ == 0)
+        {
+            arena_ = NodeArena();
+            return;
+        }
+        NodeArena arena(size_);
+        std::size_t next_slot = 0;
+        NodePtr root = relocateSubtree(end_node_.left_child.get(), &end_node_, arena, next_slot);
+        assert(next_slot == size_);
+        // The old nodes only hold moved-from elements now, destroy them before releasing the block they may live in
+        end_node_.left_child = std::move(root);
+        arena_ = std::move(arena);
+        min_node_ptr_ = arena_.Slot(0);
+    }
+
+    // Replaces the contents of the tree with "count" elements produced by successive calls to "next_element", which
+    // must return them as std::optional<value_type> in strictly ascending key order. The tree is built bottom up in
+    // O(n) with no searching or rebalancing. Returns false and leaves the tree empty if "next_element" returns
+    // std::nullopt or the keys are not strictly ascending.
+    template <typename Generator> bool AssignSorted(std::size_t count, Generator&& next_element)
+    {
+        Clear();
+        // Splitting every range at its median leaves all the nullptr leaves within one level of each other. Coloring
+        // the nodes of the deepest, partially filled level RED then gives every path the same number of BLACK nodes.
+        // That level is floor(log2(count + 1)), computed without overflowing on the untrusted counts ReadFrom passes
+        const std::size_t red_depth =
+            static_cast<std::size_t>(std::bit_width(count)) - (std::has_single_bit(count + 1) ? 0 : 1);
+        SortedBuildState state;
+        end_node_.left_child = buildSorted(&end_node_, count, 0, red_depth, next_element, state);
+        if (state.failed)
+        {
+            Clear();
+            return false;
+        }
+        size_ = count;
+        return true;
+    }
+
     static iterator begin(RBTree& tree)
     {
-        return iterator(tree.min_node_ptr_);
+        return tree.begin();
     }
 
     static iterator end(RBTree& tree)
@@ -312,7 +949,7 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
 
     iterator begin()
     {
-        return iterator(min_node_ptr_);
+        return min_node_ptr_ ? iterator(min_node_ptr_) : end();
     }
 
     iterator end()
@@ -371,14 +1008,35 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
         return current->parent;
     }
 
+    // Prefetches only the cache line holding the links of "node"
+    static void prefetchLinks(const RBTreeNode* node)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(&node->right_child);
+#else
+        (void)node;
+#endif
+    }
+
+    static void prefetchNode(const RBTreeNode* node)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        // The links live after the element, so for large elements they sit on a different cache line
+        __builtin_prefetch(node);
+        __builtin_prefetch(&node->right_child);
+#else
+        (void)node;
+#endif
+    }
+
     static void leftRotate(RBTreeNode* x)
     {
         assert(x);
         assert(x->right_child != nullptr);
         RBTreeNode* grandparent = x->parent;
         RBTreeNode* y = x->right_child.get();
-        std::unique_ptr<RBTreeNode> temp;
-        std::unique_ptr<RBTreeNode> temp2;
+        NodePtr temp;
+        NodePtr temp2;
         if (x->parent->left_child.get() == x)
         {
             temp.swap(grandparent->left_child);
@@ -399,6 +1057,12 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
             assert(temp == nullptr);
             assert(temp2 == nullptr);
         }
+        y->parent = grandparent;
+        x->parent = y;
+        if (x->right_child)
+        {
+            x->right_child->parent = x;
+        }
     }
 
     static void rightRotate(RBTreeNode* x)
@@ -407,8 +1071,8 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
         assert(x->left_child != nullptr);
         RBTreeNode* grandparent = x->parent;
         RBTreeNode* y = x->left_child.get();
-        std::unique_ptr<RBTreeNode> temp;
-        std::unique_ptr<RBTreeNode> temp2;
+        NodePtr temp;
+        NodePtr temp2;
         if (x->parent->left_child.get() == x)
         {
             temp.swap(grandparent->left_child);
@@ -429,16 +1093,98 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
             assert(temp == nullptr);
             assert(temp2 == nullptr);
         }
+        y->parent = grandparent;
+        x->parent = y;
+        if (x->left_child)
+        {
+            x->left_child->parent = x;
+        }
     }
 
-    void deleteFixup(RBTreeNode* x)
+    [[nodiscard]] static bool isBlack(const RBTreeNode* node)
     {
-        if (x == nullptr)
-            return;
-        while(x != end_node_.left_child.get() && x->color == RBTreeNode::Color::BLACK)
+        // Missing children count as BLACK leaves
+        return node == nullptr || node->color == RBTreeNode::Color::BLACK;
+    }
+
+    // "x" (possibly nullptr) is the child of "x_parent" that carries an extra BLACK after an erase. The extra BLACK is
+    // pushed up the tree until it can be absorbed by a RED node or by a rotation.
+    void deleteFixup(RBTreeNode* x, RBTreeNode* x_parent)
+    {
+        using Color = typename RBTreeNode::Color;
+        while (x != end_node_.left_child.get() && isBlack(x))
+        {
+            if (x == x_parent->left_child.get())
+            {
+                // "x" is a left child, its sibling can't be nullptr since the sibling's subtree holds the BLACK that
+                // the path through "x" is missing
+                RBTreeNode* sibling = x_parent->right_child.get();
+                if (sibling->color == Color::RED)
+                {
+                    sibling->color = Color::BLACK;
+                    x_parent->color = Color::RED;
+                    leftRotate(x_parent);
+                    sibling = x_parent->right_child.get();
+                }
+                if (isBlack(sibling->left_child.get()) && isBlack(sibling->right_child.get()))
+                {
+                    sibling->color = Color::RED;
+                    x = x_parent;
+                    x_parent = x->parent;
+                }
+                else
+                {
+                    if (isBlack(sibling->right_child.get()))
+                    {
+                        sibling->left_child->color = Color::BLACK;
+                        sibling->color = Color::RED;
+                        rightRotate(sibling);
+                        sibling = x_parent->right_child.get();
+                    }
+                    sibling->color = x_parent->color;
+                    x_parent->color = Color::BLACK;
+                    sibling->right_child->color = Color::BLACK;
+                    leftRotate(x_parent);
+                    x = end_node_.left_child.get();
+                }
+            }
+            else
+            {
+                // "x" is a right child
+                RBTreeNode* sibling = x_parent->left_child.get();
+                if (sibling->color == Color::RED)
+                {
+                    sibling->color = Color::BLACK;
+                    x_parent->color = Color::RED;
+                    rightRotate(x_parent);
+                    sibling = x_parent->left_child.get();
+                }
+                if (isBlack(sibling->left_child.get()) && isBlack(sibling->right_child.get()))
+                {
+                    sibling->color = Color::RED;
+                    x = x_parent;
+                    x_parent = x->parent;
+                }
+                else
+                {
+                    if (isBlack(sibling->left_child.get()))
+                    {
+                        sibling->right_child->color = Color::BLACK;
+                        sibling->color = Color::RED;
+                        leftRotate(sibling);
+                        sibling = x_parent->left_child.get();
+                    }
+                    sibling->color = x_parent->color;
+                    x_parent->color = Color::BLACK;
+                    sibling->left_child->color = Color::BLACK;
+                    rightRotate(x_parent);
+                    x = end_node_.left_child.get();
+                }
+            }
+        }
+        if (x)
         {
-          // TODO
-          break;
+            x->color = Color::BLACK;
         }
     }
 
@@ -504,37 +1250,105 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
     }
 
     // Returns the {parent, true} of the where "parent" is the future parent of the key that's about to be added, but if
-    // the key already exists then the function returns {node, false}  where node->key == key
+    // the key already exists then the function returns {node, false}  where node->key() == key
     [[nodiscard]] std::pair<RBTreeNode*, bool> getParent(const KeyType& key)
     {
         RBTreeNode* current = end_node_.left_child.get();
         RBTreeNode* previous = &end_node_;
+        PathComparator comparator;
         while (current)
         {
-            if (current->key == key)
+            const int order = comparator.Compare(key, current->key());
+            if (order == 0)
             {
                 // Duplicate key, the insert failed
                 return {current, false};
             }
-            else if (current->key > key)
+            previous = current;
+            current = order < 0 ? current->left_child.get() : current->right_child.get();
+        }
+        return {previous, true};
+    }
+
+    // Returns the first node whose key is not less than "key", or "end_node_" if there is no such node
+    [[nodiscard]] RBTreeNode* lowerBound(const KeyType& key)
+    {
+        RBTreeNode* current = end_node_.left_child.get();
+        RBTreeNode* result = &end_node_;
+        PathComparator comparator;
+        while (current)
+        {
+            if (comparator.NodeLess(key, current->key()))
             {
-                previous = current;
-                current = current->left_child.get();
+                current = current->right_child.get();
             }
             else
             {
-                previous = current;
+                result = current;
+                current = current->left_child.get();
+            }
+        }
+        return result;
+    }
+
+    // Finger search behind LowerBound(finger, key)
+    [[nodiscard]] RBTreeNode* lowerBound(RBTreeNode* finger, const KeyType& key)
+    {
+        if (finger == &end_node_)
+        {
+            return lowerBound(key);
+        }
+        RBTreeNode* subtree = finger;
+        // Returned if every key in "subtree" is less than "key"
+        RBTreeNode* bound = &end_node_;
+        if (finger->key() < key)
+        {
+            // Climb until "subtree" is the left child of a node whose key is not less than "key", that node is past
+            // every key in the subtree and the finger is before "key", so the answer is in the subtree or is the node.
+            // The root is the left child of "end_node_", which acts as a key past every other.
+            while (!subtree->IsLeftChild() || (subtree->parent != &end_node_ && subtree->parent->key() < key))
+            {
+                subtree = subtree->parent;
+            }
+            bound = subtree->parent;
+        }
+        else
+        {
+            if (!(key < finger->key()))
+            {
+                return finger;
+            }
+            // Mirror image: climb until "subtree" is the right child of a node whose key is less than "key". The
+            // finger is not less than "key", so the answer is in the subtree.
+            while (subtree->parent != &end_node_ && (subtree->IsLeftChild() || !(subtree->parent->key() < key)))
+            {
+                subtree = subtree->parent;
+            }
+        }
+
+        RBTreeNode* current = subtree;
+        RBTreeNode* result = bound;
+        PathComparator comparator;
+        while (current)
+        {
+            if (comparator.NodeLess(key, current->key()))
+            {
                 current = current->right_child.get();
             }
+            else
+            {
+                result = current;
+                current = current->left_child.get();
+            }
         }
-        return {previous, true};
+        return result;
     }
 
-    [[nodiscard]] std::pair<iterator, bool> insertInternal(RBTreeNode* parent, std::unique_ptr<RBTreeNode>&& new_node)
+    [[nodiscard]] std::pair<iterator, bool> insertInternal(RBTreeNode* parent, NodePtr&& new_node)
     {
         const auto new_node_raw_ptr = new_node.get();
 
-        if (min_node_ptr_ == nullptr || min_node_ptr_->key > new_node_raw_ptr->key)
+        if (min_node_ptr_ == nullptr || min_node_ptr_->key() > new_node_raw_ptr->key())
         {
             min_node_ptr_ = new_node_raw_ptr;
         }
@@ -543,7 +1357,7 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
         {
             end_node_.left_child = std::move(new_node);
         }
-        else if (parent->key > new_node->key)
+        else if (parent->key() > new_node->key())
         {
             parent->left_child = std::move(new_node);
         }
@@ -552,37 +1366,138 @@ template <std::totally_ordered KeyType, class ValueType> class RBTree
             parent->right_child = std::move(new_node);
         }
 
+        // New nodes start out RED so that attaching them never changes the black height of any path
+        new_node_raw_ptr->color = RBTreeNode::Color::RED;
         insertFixup(new_node_raw_ptr);
         ++size_;
 
         return {iterator(new_node_raw_ptr), true};
     }
 
-    [[nodiscard]] std::unique_ptr<RBTreeNode> getNewNode(RBTreeNode* parent, value_type&& element) const
+    // Moves the elements of the subtree rooted at "source" into consecutive slots of "arena", in key order, and returns
+    // the new subtree with the same shape and colors
+    [[nodiscard]] static NodePtr relocateSubtree(RBTreeNode* source, RBTreeNode* parent, NodeArena& arena,
+                                                 std::size_t& next_slot)
     {
-        auto new_node = std::make_unique<RBTreeNode>();
-        new_node->parent = parent;
-        new_node->node_value = std::move(element);
-        return new_node;
+        // The left subtree takes the lower slots, so it is relocated before this node exists and linked up afterwards
+        NodePtr left_child;
+        if (source->left_child)
+        {
+            left_child = relocateSubtree(source->left_child.get(), nullptr, arena, next_slot);
+        }
+        NodePtr node(std::construct_at(arena.Slot(next_slot++), std::in_place, std::move(source->node_value)));
+        node->arena_allocated = true;
+        node->color = source->color;
+        node->parent = parent;
+        node->left_child = std::move(left_child);
+        if (node->left_child)
+        {
+            node->left_child->parent = node.get();
+        }
+        if (source->right_child)
+        {
+            node->right_child = relocateSubtree(source->right_child.get(), node.get(), arena, next_slot);
+        }
+        return node;
+    }
+
+    // Copies the subtree rooted at "source" in pre-order
+    [[nodiscard]] NodePtr cloneSubtree(const RBTreeNode* source, RBTreeNode* parent) const
+    {
+        auto node = getNewNode(parent, source->node_value);
+        node->color = source->color;
+        if (source->left_child)
+        {
+            node->left_child = cloneSubtree(source->left_child.get(), node.get());
+        }
+        if (source->right_child)
+        {
+            node->right_child = cloneSubtree(source->right_child.get(), node.get());
+        }
+        return node;
     }
 
-    [[nodiscard]] std::unique_ptr<RBTreeNode> getNewNode(RBTreeNode* parent, const value_type& element) const
+    struct SortedBuildState
     {
-        auto new_node = std::make_unique<RBTreeNode>();
+        RBTreeNode* last = nullptr; // Most recently built node, i.e. the largest key so far
+        bool failed = false;
+    };
+
+    // Builds the subtree holding the next "count" elements of "next_element", rooted at depth "depth"
+    template <typename Generator>
+    [[nodiscard]] NodePtr buildSorted(RBTreeNode* parent, std::size_t count, std::size_t depth, std::size_t red_depth,
+                                      Generator& next_element, SortedBuildState& state)
+    {
+        if (count == 0 || state.failed)
+        {
+            return nullptr;
+        }
+        const std::size_t left_count = (count - 1) / 2;
+        auto left_child = buildSorted(nullptr, left_count, depth + 1, red_depth, next_element, state);
+        if (state.failed)
+        {
+            return nullptr;
+        }
+
+        std::optional<value_type> element = next_element();
+        if (!element || (state.last && !(state.last->key() < element->first)))
+        {
+            state.failed = true;
+            return nullptr;
+        }
+        auto node = getNewNode(parent, std::move(*element));
+        node->color = depth == red_depth ? RBTreeNode::Color::RED : RBTreeNode::Color::BLACK;
+        node->left_child = std::move(left_child);
+        if (node->left_child)
+        {
+            node->left_child->parent = node.get();
+        }
+        if (min_node_ptr_ == nullptr)
+        {
+            min_node_ptr_ = node.get();
+        }
+        state.last = node.get();
+
+        node->right_child = buildSorted(node.get(), count - 1 - left_count, depth + 1, red_depth, next_element, state);
+        return node;
+    }
+
+    template <typename Key, typename... Args> std::pair<iterator, bool> tryEmplace(Key&& key, Args&&... args)
+    {
+        const auto [parent, result] = getParent(key);
+        if (result == false)
+        {
+            return {iterator(parent), false};
+        }
+        return insertInternal(parent, getNewNode(parent, std::piecewise_construct,
+                                                 std::forward_as_tuple(std::forward<Key>(key)),
+                                                 std::forward_as_tuple(std::forward<Args>(args)...)));
+    }
+
+    // Inserts a node whose element is already constructed, it is discarded if its key is already present
+    [[nodiscard]] std::pair<iterator, bool> emplaceNode(NodePtr&& new_node)
+    {
+        const auto [parent, result] = getParent(new_node->key());
+        if (result == false)
+        {
+            return {iterator(parent), false};
+        }
         new_node->parent = parent;
-        new_node->node_value = element;
-        return new_node;
+        return insertInternal(parent, std::move(new_node));
     }
 
-    template <typename First, typename Second>
-    [[nodiscard]] std::unique_ptr<RBTreeNode> getNewNode(RBTreeNode* parent, First&& first, Second&& second) const
+    // Constructs the element of the new node in place from "args"
+    template <typename... Args>
+    [[nodiscard]] NodePtr getNewNode(RBTreeNode* parent, Args&&... args) const
     {
-        auto new_node = std::make_unique<RBTreeNode>(std::forward<First>(first), std::forward<Second>(second));
+        NodePtr new_node(new RBTreeNode(std::in_place, std::forward<Args>(args)...));
         new_node->parent = parent;
         return new_node;
     }
 
   private:
+    // Declared before "end_node_" so that the nodes placed in it are destroyed before the block is released
+    NodeArena arena_;
     // "end_node_" will always have its left_child pointing to the root of the
     // tree
     RBTreeNode end_node_;
@@ -0,0 +1,205 @@
+#ifndef MAP_STATIC_MAP_H
+#define MAP_STATIC_MAP_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+// Immutable map of "N" elements fixed at compile time, for lookup tables such as protocol codes or opcode names.
+// Construction is constexpr: the elements are sorted, checked for duplicate keys and laid out in one flat array, so a
+// "static constexpr" StaticMap lives in read-only data with no allocation and no startup cost. Duplicate keys are a
+// compile error when constructed at compile time and throw std::invalid_argument otherwise.
+//
+// The array is in Eytzinger order, the implicit binary search tree stored level by level: the children of the element
+// at 1-based position k are at 2k and 2k + 1. A lookup descends it with a branch-free index computation, touching the
+// top levels of the tree in the same few cache lines for every key.
+template <std::totally_ordered KeyType, class ValueType, std::size_t N> class StaticMap
+{
+  public:
+    using value_type = std::pair<KeyType, ValueType>;
+
+    // Iterates in key order. Positions are 1-based Eytzinger positions, 0 is end().
+    class ConstIterator
+    {
+      public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = StaticMap::value_type;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+      public:
+        constexpr ConstIterator() = default;
+
+        constexpr reference operator*() const
+        {
+            return map_->entries_[position_ - 1];
+        }
+        constexpr pointer operator->() const
+        {
+            return &(**this);
+        }
+
+        constexpr ConstIterator& operator++()
+        {
+            if (2 * position_ + 1 <= N)
+            {
+                position_ = leftMost(2 * position_ + 1);
+            }
+            else
+            {
+                // Climb past the ancestors whose right subtree this was, then once more to the first left turn
+                position_ >>= std::countr_one(position_) + 1;
+            }
+            return *this;
+        }
+        constexpr ConstIterator& operator--()
+        {
+            if (position_ == 0)
+            {
+                position_ = rightMost(1);
+            }
+            else if (2 * position_ <= N)
+            {
+                position_ = rightMost(2 * position_);
+            }
+            else
+            {
+                position_ >>= std::countr_zero(position_) + 1;
+            }
+            return *this;
+        }
+        constexpr ConstIterator operator++(int)
+        {
+            ConstIterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        constexpr ConstIterator operator--(int)
+        {
+            ConstIterator previous = *this;
+            --*this;
+            return previous;
+        }
+
+        constexpr bool operator==(const ConstIterator& other) const = default;
+
+      private:
+        friend class StaticMap;
+        constexpr ConstIterator(const StaticMap* map, std::size_t position) : map_(map), position_(position)
+        {
+        }
+
+        const StaticMap* map_ = nullptr;
+        std::size_t position_ = 0;
+    };
+    using iterator = ConstIterator;
+
+  public:
+    constexpr explicit StaticMap(const value_type (&elements)[N]) : StaticMap(std::to_array(elements))
+    {
+    }
+    constexpr explicit StaticMap(std::array<value_type, N> elements)
+    {
+        std::sort(elements.begin(), elements.end(),
+                  [](const value_type& a, const value_type& b) { return a.first < b.first; });
+        if (std::adjacent_find(elements.begin(), elements.end(), [](const value_type& a, const value_type& b) {
+                return a.first == b.first;
+            }) != elements.end())
+        {
+            throw std::invalid_argument("StaticMap keys must be unique");
+        }
+        std::size_t next = 0;
+        layOut(elements, 1, next);
+    }
+
+    [[nodiscard]] constexpr std::size_t Size() const
+    {
+        return N;
+    }
+    [[nodiscard]] constexpr bool Empty() const
+    {
+        return N == 0;
+    }
+
+    // Returns an iterator to the element with key "key", or end() if there is no such element
+    constexpr iterator Find(const KeyType& key) const
+    {
+        const iterator bound = LowerBound(key);
+        if (bound != end() && bound->first == key)
+        {
+            return bound;
+        }
+        return end();
+    }
+
+    // Returns an iterator to the first element whose key is not less than "key", or end() if there is no such element
+    constexpr iterator LowerBound(const KeyType& key) const
+    {
+        std::size_t position = 1;
+        while (position <= N)
+        {
+            position = 2 * position + static_cast<std::size_t>(entries_[position - 1].first < key);
+        }
+        // Every right turn after the last left turn went past a smaller key, undo them and the left turn itself
+        position >>= std::countr_one(position) + 1;
+        return iterator(this, position);
+    }
+
+    constexpr iterator begin() const
+    {
+        return iterator(this, N == 0 ? 0 : leftMost(1));
+    }
+    constexpr iterator end() const
+    {
+        return iterator(this, 0);
+    }
+
+  private:
+    static constexpr std::size_t leftMost(std::size_t position)
+    {
+        while (2 * position <= N)
+        {
+            position *= 2;
+        }
+        return position;
+    }
+    static constexpr std::size_t rightMost(std::size_t position)
+    {
+        while (2 * position + 1 <= N)
+        {
+            position = 2 * position + 1;
+        }
+        return position;
+    }
+
+    // Fills the subtree rooted at "position" in order, taking elements from "sorted" starting at "next"
+    constexpr void layOut(std::array<value_type, N>& sorted, std::size_t position, std::size_t& next)
+    {
+        if (position > N)
+        {
+            return;
+        }
+        layOut(sorted, 2 * position, next);
+        entries_[position - 1] = std::move(sorted[next++]);
+        layOut(sorted, 2 * position + 1, next);
+    }
+
+  private:
+    std::array<value_type, N> entries_{};
+};
+
+// Builds a StaticMap deducing its size from the braced list, e.g.
+//      static constexpr auto kOpcodes = MakeStaticMap<int, std::string_view>({{0x01, "nop"}, {0x02, "load"}});
+template <class KeyType, class ValueType, std::size_t N>
+constexpr StaticMap<KeyType, ValueType, N> MakeStaticMap(const std::pair<KeyType, ValueType> (&elements)[N])
+{
+    return StaticMap<KeyType, ValueType, N>(elements);
+}
+
+#endif // MAP_STATIC_MAP_H
@@ -0,0 +1,460 @@
+#ifndef MAP_STRING_MAP_H
+#define MAP_STRING_MAP_H
+
+#include <algorithm>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "rbtree.h"
+
+// Key of a StringMap in 16 bytes: the length, then either the whole key if it fits in "kInlineSize" bytes or its first
+// "kPrefixSize" bytes followed by a pointer to all of its bytes in the map's KeyArena. Comparisons check the cached
+// prefix before following the pointer, which decides most of them for keys that differ early.
+class StringKey
+{
+  public:
+    static constexpr std::size_t kInlineSize = 12;
+    static constexpr std::size_t kPrefixSize = 4;
+
+  public:
+    StringKey() = default;
+
+    // Refers to "bytes" without copying them unless they fit inline
+    explicit StringKey(std::string_view bytes) : size_(static_cast<std::uint32_t>(bytes.size()))
+    {
+        assert(bytes.size() <= std::numeric_limits<std::uint32_t>::max());
+        if (bytes.size() <= kInlineSize)
+        {
+            std::copy_n(bytes.data(), bytes.size(), bytes_);
+        }
+        else
+        {
+            const char* const data = bytes.data();
+            std::memcpy(bytes_, data, kPrefixSize);
+            std::memcpy(bytes_ + kPrefixSize, &data, sizeof(data));
+        }
+    }
+
+    // The bytes of an inline key live in the key itself, the view is invalidated when the key moves
+    [[nodiscard]] std::string_view View() const
+    {
+        if (IsInline())
+        {
+            return {bytes_, size_};
+        }
+        const char* data;
+        std::memcpy(&data, bytes_ + kPrefixSize, sizeof(data));
+        return {data, size_};
+    }
+    explicit operator std::string_view() const
+    {
+        return View();
+    }
+
+    [[nodiscard]] std::size_t Size() const
+    {
+        return size_;
+    }
+    [[nodiscard]] bool IsInline() const
+    {
+        return size_ <= kInlineSize;
+    }
+
+    // The unused bytes of a short key are zero, which orders before every byte, so a difference in the cached
+    // prefixes always decides the comparison
+    friend bool operator==(const StringKey& a, const StringKey& b)
+    {
+        return a.size_ == b.size_ && std::memcmp(a.bytes_, b.bytes_, kPrefixSize) == 0 && a.View() == b.View();
+    }
+    friend std::strong_ordering operator<=>(const StringKey& a, const StringKey& b)
+    {
+        if (const int prefix_order = std::memcmp(a.bytes_, b.bytes_, kPrefixSize); prefix_order != 0)
+        {
+            return prefix_order <=> 0;
+        }
+        return a.View().compare(b.View()) <=> 0;
+    }
+
+  private:
+    std::uint32_t size_ = 0;
+    char bytes_[kInlineSize]{};
+};
+static_assert(sizeof(StringKey) == 16 && std::is_trivially_copyable_v<StringKey>);
+
+template <> inline constexpr bool kOrderedAsString<StringKey> = true;
+
+// Append-only storage for the bytes of a map's long keys. Bytes never move, so keys can point into the arena, and are
+// only released all at once.
+class KeyArena
+{
+  public:
+    static constexpr std::size_t kMinBlockSize = 4096;
+    static constexpr std::size_t kMaxBlockSize = 1 << 20;
+
+  public:
+    KeyArena() = default;
+    KeyArena(KeyArena&& other) noexcept
+        : blocks_(std::move(other.blocks_)), next_(std::exchange(other.next_, nullptr)),
+          available_(std::exchange(other.available_, 0)), block_size_(std::exchange(other.block_size_, 0)),
+          used_(std::exchange(other.used_, 0))
+    {
+        other.blocks_.clear();
+    }
+    KeyArena& operator=(KeyArena&& other) noexcept
+    {
+        KeyArena moved(std::move(other));
+        Swap(moved);
+        return *this;
+    }
+
+    void Swap(KeyArena& other) noexcept
+    {
+        blocks_.swap(other.blocks_);
+        std::swap(next_, other.next_);
+        std::swap(available_, other.available_);
+        std::swap(block_size_, other.block_size_);
+        std::swap(used_, other.used_);
+    }
+
+    // Copies "bytes" into the arena and returns where they were placed
+    const char* Store(std::string_view bytes)
+    {
+        if (bytes.size() > available_)
+        {
+            grow(bytes.size());
+        }
+        char* const out = next_;
+        std::memcpy(out, bytes.data(), bytes.size());
+        next_ += bytes.size();
+        available_ -= bytes.size();
+        used_ += bytes.size();
+        return out;
+    }
+
+    // Makes room for "size" more bytes in the current block, so that storing them allocates nothing more
+    void Reserve(std::size_t size)
+    {
+        if (size > available_)
+        {
+            grow(size);
+        }
+    }
+
+    void Clear()
+    {
+        blocks_.clear();
+        next_ = nullptr;
+        available_ = 0;
+        used_ = 0;
+    }
+
+    // Bytes stored so far, including those of keys erased since
+    [[nodiscard]] std::size_t UsedBytes() const
+    {
+        return used_;
+    }
+
+  private:
+    // Blocks double in size up to "kMaxBlockSize", a key larger than the next block gets a block of its own
+    void grow(std::size_t size)
+    {
+        const std::size_t block_size = blocks_.empty() ? kMinBlockSize : std::min(2 * block_size_, kMaxBlockSize);
+        block_size_ = std::max(block_size, size);
+        blocks_.push_back(std::make_unique_for_overwrite<char[]>(block_size_));
+        next_ = blocks_.back().get();
+        available_ = block_size_;
+    }
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* next_ = nullptr;
+    std::size_t available_ = 0; // Bytes left after "next_" in the last block
+    std::size_t block_size_ = 0;
+    std::size_t used_ = 0;
+};
+
+// Ordered map from strings to ValueType for large sets of long keys, like paths or metric names. Instead of a
+// std::string with an allocation of its own, every node holds a StringKey whose bytes, unless they fit inline, live in
+// a per-map KeyArena. A key that is a prefix of the key following it, like a directory followed by the paths under
+// it, points into that key's bytes and takes no arena space. Lookups skip the prefix known to be shared with the
+// search key, see RBTree::PathComparator.
+//
+// Iterators yield std::pair<std::string_view, ValueType&>. Erased keys keep their arena bytes until Compact() or
+// Clear().
+template <class ValueType> class StringMap
+{
+  private:
+    using Tree = RBTree<StringKey, ValueType>;
+    using tree_iterator = typename Tree::iterator;
+
+  public:
+    using value_type = std::pair<std::string_view, ValueType&>;
+
+    class Iterator
+    {
+      public:
+        // operator-> points into a copy of the pair operator* returns
+        struct ArrowProxy
+        {
+            value_type element;
+            const value_type* operator->() const
+            {
+                return &element;
+            }
+        };
+
+      public:
+        Iterator() = default;
+
+        [[nodiscard]] bool operator==(const Iterator& other) const
+        {
+            return it_ == other.it_;
+        }
+
+        value_type operator*() const
+        {
+            tree_iterator it = it_;
+            return {it->first.View(), it->second};
+        }
+        ArrowProxy operator->() const
+        {
+            return {**this};
+        }
+
+        Iterator& operator++()
+        {
+            ++it_;
+            return *this;
+        }
+        Iterator& operator--()
+        {
+            --it_;
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            auto temp(*this);
+            ++it_;
+            return temp;
+        }
+        Iterator operator--(int)
+        {
+            auto temp(*this);
+            --it_;
+            return temp;
+        }
+
+      private:
+        friend class StringMap;
+
+        explicit Iterator(tree_iterator it) : it_(it)
+        {
+        }
+
+        tree_iterator it_;
+    };
+
+    using iterator = Iterator;
+
+  public:
+    StringMap() = default;
+
+    // Copies the tree node for node, then stores the copied keys in an arena of their own
+    StringMap(const StringMap& other)
+        requires std::is_copy_constructible_v<ValueType>
+        : tree_(other.tree_)
+    {
+        restoreKeys();
+    }
+
+    StringMap& operator=(const StringMap& other)
+        requires std::is_copy_constructible_v<ValueType>
+    {
+        StringMap copy(other);
+        Swap(copy);
+        return *this;
+    }
+
+    StringMap(StringMap&& other) noexcept = default;
+    StringMap& operator=(StringMap&& other) noexcept = default;
+
+    void Swap(StringMap& other) noexcept
+    {
+        arena_.Swap(other.arena_);
+        tree_.Swap(other.tree_);
+    }
+
+    [[nodiscard]] std::size_t Size() const
+    {
+        return tree_.Size();
+    }
+    [[nodiscard]] bool Empty() const
+    {
+        return Size() == 0;
+    }
+
+    // Inserts an element with key "key" and a value constructed in place from "args", unless "key" is already present
+    // in which case nothing is stored and "args" are left untouched
+    template <typename... Args> std::pair<iterator, bool> TryEmplace(std::string_view key, Args&&... args)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        const auto [it, inserted] = tree_.TryEmplace(StringKey(key), std::forward<Args>(args)...);
+        if (inserted)
+        {
+            store(it);
+        }
+        return {iterator(it), inserted};
+    }
+    std::pair<iterator, bool> Insert(std::string_view key, const ValueType& value)
+    {
+        return TryEmplace(key, value);
+    }
+    std::pair<iterator, bool> Insert(std::string_view key, ValueType&& value)
+    {
+        return TryEmplace(key, std::move(value));
+    }
+
+    template <typename Value> std::pair<iterator, bool> InsertOrAssign(std::string_view key, Value&& value)
+    {
+        MAP_PERF_SCOPE(INSERT);
+        const auto [it, inserted] = tree_.InsertOrAssign(StringKey(key), std::forward<Value>(value));
+        if (inserted)
+        {
+            store(it);
+        }
+        return {iterator(it), inserted};
+    }
+
+    // Removes the element pointed to by "to_delete" and returns an iterator to the element that followed it
+    iterator Erase(iterator to_delete)
+    {
+        return iterator(tree_.Erase(to_delete.it_));
+    }
+
+    iterator Find(std::string_view key)
+    {
+        return iterator(tree_.Find(StringKey(key)));
+    }
+    [[nodiscard]] bool Contains(std::string_view key)
+    {
+        return Find(key) != end();
+    }
+    iterator LowerBound(std::string_view key)
+    {
+        return iterator(tree_.LowerBound(StringKey(key)));
+    }
+
+    // Calls "visitor" with every element whose key lies in [lo, hi), in key order, and returns how many were visited
+    template <typename Visitor> std::size_t Scan(std::string_view lo, std::string_view hi, Visitor&& visitor)
+    {
+        return tree_.Scan(StringKey(lo), StringKey(hi), [&visitor](typename Tree::value_type& element) {
+            visitor(value_type(element.first.View(), element.second));
+        });
+    }
+
+    void Clear()
+    {
+        tree_.Clear();
+        arena_.Clear();
+    }
+
+    // Stores the keys again in a fresh arena, which drops the bytes of erased keys and shares the bytes of every key
+    // that is a prefix of the next one, then relocates the nodes in key order, see RBTree::Compact. Invalidates all
+    // iterators.
+    void Compact()
+    {
+        restoreKeys();
+        tree_.Compact();
+    }
+
+    // Bytes of key storage in use, not counting the keys stored inline
+    [[nodiscard]] std::size_t ArenaBytes() const
+    {
+        return arena_.UsedBytes();
+    }
+
+    iterator begin()
+    {
+        return iterator(tree_.begin());
+    }
+    iterator end()
+    {
+        return iterator(tree_.end());
+    }
+
+  private:
+    // A freshly inserted key still refers to the caller's bytes, points it into the arena
+    void store(tree_iterator position)
+    {
+        StringKey& key = position->first;
+        if (key.IsInline())
+        {
+            return;
+        }
+        tree_iterator next = position;
+        ++next;
+        key = intern(key.View(), next == tree_.end() ? nullptr : &next->first);
+    }
+
+    // Stores "bytes" in the arena unless they start "successor", the key following them, whose bytes are then shared
+    StringKey intern(std::string_view bytes, const StringKey* successor)
+    {
+        if (sharesBytes(bytes, successor))
+        {
+            return StringKey(successor->View().substr(0, bytes.size()));
+        }
+        return StringKey(std::string_view(arena_.Store(bytes), bytes.size()));
+    }
+
+    static bool sharesBytes(std::string_view bytes, const StringKey* successor)
+    {
+        return successor != nullptr && !successor->IsInline() && successor->View().starts_with(bytes);
+    }
+
+    // Stores every key in a fresh arena, from the largest down so that each key can share its successor's bytes. The
+    // keys are read before the old arena, or the one of the map they were copied from, goes away.
+    void restoreKeys()
+    {
+        const KeyArena old_arena(std::move(arena_));
+        // A first pass sizes the arena, so that the keys end up in a single block, no smaller than "kMinBlockSize"
+        std::size_t size = 0;
+        const StringKey* successor = nullptr;
+        for (auto it = tree_.end(); it != tree_.begin();)
+        {
+            --it;
+            const StringKey& key = it->first;
+            if (!key.IsInline() && !sharesBytes(key.View(), successor))
+            {
+                size += key.Size();
+            }
+            successor = &key;
+        }
+        arena_.Reserve(size);
+
+        successor = nullptr;
+        for (auto it = tree_.end(); it != tree_.begin();)
+        {
+            --it;
+            StringKey& key = it->first;
+            if (!key.IsInline())
+            {
+                key = intern(key.View(), successor);
+            }
+            successor = &key;
+        }
+    }
+
+    KeyArena arena_;
+    // Declared after the arena its keys point into
+    Tree tree_;
+};
+
+#endif // MAP_STRING_MAP_H
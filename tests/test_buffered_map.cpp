@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <string>
+
+#include "buffered_map.h"
+
+TEST(TEST_BUFFERED_MAP, TestWritesAreBufferedUntilThreshold)
+{
+    BufferedMap<int, std::string> map(4);
+    map.Insert({1, "one"});
+    map.InsertOrAssign(2, "two");
+    map.Erase(1);
+    ASSERT_EQ(3, map.BufferedCount());
+    ASSERT_FALSE(map.Contains(1));
+    ASSERT_EQ("two", *map.Get(2));
+
+    // The fourth write reaches the threshold
+    map.Insert({3, "three"});
+    ASSERT_EQ(0, map.BufferedCount());
+    ASSERT_EQ(2, map.Flushed().Size());
+    ASSERT_EQ("three", map.Flushed().Find(3)->second);
+
+    map.Insert({3, "ignored"});
+    map.Insert({4, "four"});
+    ASSERT_EQ("three", *map.Get(3));
+    ASSERT_EQ("four", *map.Get(4));
+    ASSERT_EQ(nullptr, map.Get(5));
+    // Ordered reads see the buffered writes
+    ASSERT_EQ(4, map.LowerBound(4)->first);
+    ASSERT_EQ(0, map.BufferedCount());
+    ASSERT_EQ(3, map.Size());
+}
+
+TEST(TEST_BUFFERED_MAP, TestAgainstStdMap)
+{
+    BufferedMap<int, int> map(64);
+    std::map<int, int> expected;
+    std::mt19937 generator(7);
+    for (int i = 0; i < 20000; ++i)
+    {
+        const int key = static_cast<int>(generator() % 500);
+        switch (generator() % 4)
+        {
+        case 0:
+            map.Insert({key, i});
+            expected.emplace(key, i);
+            break;
+        case 1:
+            map.InsertOrAssign(key, i);
+            expected.insert_or_assign(key, i);
+            break;
+        case 2:
+            map.Erase(key);
+            expected.erase(key);
+            break;
+        case 3: {
+            const auto found = expected.find(key);
+            const int* value = map.Get(key);
+            if (found == expected.end())
+            {
+                ASSERT_EQ(nullptr, value);
+            }
+            else
+            {
+                ASSERT_NE(nullptr, value);
+                ASSERT_EQ(found->second, *value);
+            }
+            break;
+        }
+        }
+    }
+
+    ASSERT_EQ(expected.size(), map.Size());
+    auto expected_iterator = expected.begin();
+    for (const auto& [key, value] : map)
+    {
+        ASSERT_EQ(expected_iterator->first, key);
+        ASSERT_EQ((expected_iterator++)->second, value);
+    }
+}
@@ -3,8 +3,44 @@
 //
 #include <gtest/gtest.h>
 
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
 #include "map.h"
 
+namespace
+{
+std::size_t allocation_count = 0;
+} // namespace
+
+// Counts heap allocations so that tests can check which operations allocate
+void* operator new(std::size_t size)
+{
+    ++allocation_count;
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+// Not inlined, GCC would otherwise see std::free called on memory from operator new and warn about the mismatch
+[[gnu::noinline]] void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+[[gnu::noinline]] void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
 TEST(TEST_MAP, TestEmptyOnConstruction)
 {
     Map<int, int> tree;
@@ -12,6 +48,358 @@ TEST(TEST_MAP, TestEmptyOnConstruction)
     ASSERT_EQ(true, tree.Empty());
 }
 
+TEST(TEST_MAP, TestScan)
+{
+    Map<int, int> map;
+    for (int key = 9; key >= 0; --key)
+    {
+        map.Insert({key, -key});
+    }
+
+    std::vector<int> visited;
+    map.Scan(3, 7, [&](const auto& element) { visited.push_back(element.first); });
+    ASSERT_EQ((std::vector<int>{3, 4, 5, 6}), visited);
+
+    auto cursor = map.Range(8, 100);
+    ASSERT_EQ(8, cursor->first);
+    ASSERT_EQ(9, (++cursor)->first);
+    ASSERT_TRUE((++cursor).Done());
+}
+
+TEST(TEST_MAP, TestFindMany)
+{
+    Map<int, int> map;
+    for (int key = 0; key < 100; ++key)
+    {
+        map.Insert({key, key + 1});
+    }
+
+    const std::vector<int> keys{5, 500, 99, -3};
+    std::vector<Map<int, int>::iterator> results(keys.size());
+    map.FindMany(keys, results);
+    ASSERT_EQ(6, results[0]->second);
+    ASSERT_EQ(map.end(), results[1]);
+    ASSERT_EQ(100, results[2]->second);
+    ASSERT_EQ(map.end(), results[3]);
+    ASSERT_EQ(map.Find(99), results[2]);
+}
+
+TEST(TEST_MAP, TestWriteToReadFrom)
+{
+    using namespace std::string_literals;
+    Map<std::string, int> map;
+    for (int i = 0; i < 500; ++i)
+    {
+        map.Insert({"/metrics/host" + std::to_string(i * 37 % 500), i});
+    }
+    std::stringstream stream;
+    ASSERT_TRUE(map.WriteTo(stream));
+
+    Map<std::string, int> loaded;
+    loaded.Insert({"stale"s, 0});
+    ASSERT_TRUE(loaded.ReadFrom(stream));
+    ASSERT_EQ(map.Size(), loaded.Size());
+    auto loaded_iterator = loaded.begin();
+    for (const auto& [key, value] : map)
+    {
+        ASSERT_EQ(key, loaded_iterator->first);
+        ASSERT_EQ(value, (loaded_iterator++)->second);
+    }
+    ASSERT_EQ(loaded.end(), loaded_iterator);
+}
+
+TEST(TEST_MAP, TestReadFromRejectsCorruptedStream)
+{
+    Map<int, int> map;
+    for (int key = 0; key < 10; ++key)
+    {
+        map.Insert({key, key});
+    }
+    std::stringstream stream;
+    ASSERT_TRUE(map.WriteTo(stream));
+    auto bytes = stream.str();
+
+    auto corrupted = bytes;
+    corrupted[30] ^= 1;
+    std::stringstream corrupted_stream(corrupted);
+    Map<int, int> loaded;
+    ASSERT_FALSE(loaded.ReadFrom(corrupted_stream));
+    ASSERT_TRUE(loaded.Empty());
+
+    std::stringstream truncated_stream(bytes.substr(0, bytes.size() - 12));
+    ASSERT_FALSE(loaded.ReadFrom(truncated_stream));
+    ASSERT_TRUE(loaded.Empty());
+
+    // Record counts far beyond what the stream holds, the count follows the 8 byte magic and the 4 byte version
+    for (const std::uint64_t count : {~std::uint64_t{0}, std::uint64_t{1} << 63, std::uint64_t{11}})
+    {
+        auto miscounted = bytes;
+        std::memcpy(miscounted.data() + 12, &count, sizeof(count));
+        std::stringstream miscounted_stream(miscounted);
+        ASSERT_FALSE(loaded.ReadFrom(miscounted_stream));
+        ASSERT_TRUE(loaded.Empty());
+    }
+}
+
+TEST(TEST_MAP, TestCheckpoint)
+{
+    Map<int, int> map;
+    for (int key = 0; key < 100; ++key)
+    {
+        map.Insert({key, key});
+    }
+    std::stringstream snapshot;
+    ASSERT_TRUE(map.WriteTo(snapshot));
+    map.StartChangeTracking();
+
+    Map<int, int> replica;
+    ASSERT_TRUE(replica.ReadFrom(snapshot));
+
+    map.Erase(map.Find(10));
+    map.Insert({1000, 1});
+    map.Find(20)->second = -20;
+    map.MarkChanged(20);
+    // Inserted then erased within the same interval
+    map.Erase(map.Insert({2000, 2}).first);
+
+    std::stringstream checkpoint;
+    ASSERT_TRUE(map.WriteCheckpoint(checkpoint));
+    // Only the changed keys are written
+    ASSERT_LT(checkpoint.str().size(), 100u);
+
+    map.Erase(map.Find(30));
+    std::stringstream second_checkpoint;
+    ASSERT_TRUE(map.WriteCheckpoint(second_checkpoint));
+
+    ASSERT_TRUE(replica.ApplyCheckpoint(checkpoint));
+    ASSERT_TRUE(replica.ApplyCheckpoint(second_checkpoint));
+    ASSERT_EQ(map.Size(), replica.Size());
+    auto replica_iterator = replica.begin();
+    for (const auto& [key, value] : map)
+    {
+        ASSERT_EQ(key, replica_iterator->first);
+        ASSERT_EQ(value, (replica_iterator++)->second);
+    }
+
+    // A corrupted checkpoint is rejected without touching the map
+    std::stringstream empty_checkpoint;
+    ASSERT_TRUE(map.WriteCheckpoint(empty_checkpoint));
+    auto bytes = empty_checkpoint.str();
+    bytes.back() ^= 1;
+    std::stringstream corrupted(bytes);
+    ASSERT_FALSE(replica.ApplyCheckpoint(corrupted));
+    ASSERT_EQ(map.Size(), replica.Size());
+}
+
+TEST(TEST_MAP, TestSwapAndClone)
+{
+    Map<int, int> active;
+    Map<int, int> staging;
+    for (int key = 0; key < 10; ++key)
+    {
+        active.Insert({key, 1});
+        staging.Insert({key, 2});
+    }
+    staging.Insert({10, 2});
+
+    active.Swap(staging);
+    ASSERT_EQ(11, active.Size());
+    ASSERT_EQ(2, active.Find(0)->second);
+    ASSERT_EQ(1, staging.Find(0)->second);
+
+    auto copy = active.Clone();
+    copy.InsertOrAssign(0, 3);
+    ASSERT_EQ(2, active.Find(0)->second);
+
+    Map<int, int> moved(std::move(copy));
+    ASSERT_EQ(3, moved.Find(0)->second);
+    ASSERT_TRUE(copy.Empty());
+}
+
+TEST(TEST_MAP, TestCompact)
+{
+    Map<int, int, 8> map;
+    map.Insert({1, 1});
+    map.Compact();
+    ASSERT_EQ(1, map.Find(1)->second);
+
+    for (int key = 0; key < 100; ++key)
+    {
+        map.InsertOrAssign(key, key);
+    }
+    map.Compact();
+    map.Erase(map.Find(50));
+    map.Insert({100, 100});
+    ASSERT_EQ(100, map.Size());
+    int expected_key = 0;
+    for (const auto& [key, value] : map)
+    {
+        expected_key += expected_key == 50 ? 1 : 0;
+        ASSERT_EQ(expected_key++, key);
+    }
+}
+
+TEST(TEST_MAP, TestFingerCursor)
+{
+    // Through the inline array, the promotion to the tree and back
+    Map<int, int, 8> map;
+    Map<int, int, 8>::FingerCursor cursor(map);
+    for (int key = 0; key < 40; ++key)
+    {
+        map.Insert({key * 2, key});
+        for (int probe = 0; probe <= 2 * key; ++probe)
+        {
+            ASSERT_EQ(probe % 2 == 0, cursor.Find(probe) != map.end());
+            const auto bound = cursor.LowerBound(probe);
+            ASSERT_NE(map.end(), bound);
+            ASSERT_EQ((probe + 1) / 2 * 2, bound->first);
+        }
+        cursor.Reset();
+    }
+    while (map.Size() > 2)
+    {
+        map.Erase(map.begin());
+        cursor.Reset();
+        ASSERT_EQ(map.begin(), cursor.LowerBound(0));
+        auto last = map.end();
+        --last;
+        ASSERT_EQ(last, map.Find(map.begin(), last->first));
+    }
+}
+
+TEST(TEST_MAP, TestInlineStorageDoesNotAllocate)
+{
+    const auto allocations_before = allocation_count;
+    Map<int, int, 8> map;
+    for (int key = 7; key >= 0; --key)
+    {
+        ASSERT_TRUE(map.Insert({key, key}).second);
+    }
+    ASSERT_FALSE(map.TryEmplace(3, 0).second);
+    map.InsertOrAssign(3, 30);
+    map.Erase(map.Find(5));
+    map.Emplace(5, 50);
+    ASSERT_EQ(30, map.Find(3)->second);
+    ASSERT_EQ(50, map.LowerBound(5)->second);
+    ASSERT_EQ(allocations_before, allocation_count);
+}
+
+TEST(TEST_MAP, TestInlineEmplaceLooksUpTheKeyFirst)
+{
+    Map<int, std::string, 8> map;
+    map.Emplace(1, "one");
+    const auto allocations_before = allocation_count;
+    // Either value would need a heap allocation if it were constructed
+    ASSERT_FALSE(map.Emplace(1, "a value far too long to fit in the small string buffer").second);
+    ASSERT_FALSE(
+        map.Emplace(std::piecewise_construct, std::forward_as_tuple(1), std::forward_as_tuple(64, 'x')).second);
+    ASSERT_EQ(allocations_before, allocation_count);
+    ASSERT_EQ("one", map.Find(1)->second);
+
+    ASSERT_TRUE(map.Emplace(std::piecewise_construct, std::forward_as_tuple(2), std::forward_as_tuple(3, 'x')).second);
+    ASSERT_TRUE(map.Emplace(std::pair<int, std::string>(3, "three")).second);
+    ASSERT_EQ("xxx", map.Find(2)->second);
+    ASSERT_EQ("three", map.Find(3)->second);
+}
+
+TEST(TEST_MAP, TestInlineStoragePromotesAndDemotes)
+{
+    Map<int, std::string, 4> map;
+    std::map<int, std::string> reference;
+    auto check = [&]() {
+        ASSERT_EQ(reference.size(), map.Size());
+        auto it = map.begin();
+        for (const auto& [key, value] : reference)
+        {
+            ASSERT_EQ(key, it->first);
+            ASSERT_EQ(value, (it++)->second);
+            ASSERT_EQ(value, map.Find(key)->second);
+        }
+        ASSERT_EQ(map.end(), it);
+        ASSERT_EQ(map.end(), map.Find(1000));
+    };
+
+    for (int key : {40, 10, 30, 20})
+    {
+        map.Insert({key, std::to_string(key)});
+        reference.insert({key, std::to_string(key)});
+    }
+    check();
+
+    // Going past the capacity moves everything into the tree
+    auto [it, inserted] = map.Insert({25, "25"});
+    reference.insert({25, "25"});
+    ASSERT_TRUE(inserted);
+    ASSERT_EQ(25, it->first);
+    ASSERT_EQ(30, (++it)->first);
+    check();
+    for (int key = 50; key < 100; ++key)
+    {
+        map.TryEmplace(key, std::to_string(key));
+        reference.insert({key, std::to_string(key)});
+    }
+    check();
+
+    std::vector<int> scanned;
+    map.Scan(20, 51, [&](const auto& element) { scanned.push_back(element.first); });
+    ASSERT_EQ((std::vector<int>{20, 25, 30, 40, 50}), scanned);
+
+    // Erasing down to half the capacity moves everything back, the returned iterator is still the successor
+    while (map.Size() > 3)
+    {
+        auto next = map.Erase(map.Find(reference.rbegin()->first));
+        reference.erase(std::prev(reference.end()));
+        ASSERT_EQ(map.end(), next);
+    }
+    auto next = map.Erase(map.Find(20));
+    reference.erase(20);
+    ASSERT_EQ(25, next->first);
+    check();
+
+    scanned.clear();
+    map.Scan(0, 100, [&](const auto& element) { scanned.push_back(element.first); });
+    ASSERT_EQ((std::vector<int>{10, 25}), scanned);
+
+    std::vector<int> keys{25, 11, 10};
+    std::vector<Map<int, std::string, 4>::iterator> results(keys.size());
+    map.FindMany(keys, results);
+    ASSERT_EQ("25", results[0]->second);
+    ASSERT_EQ(map.end(), results[1]);
+    ASSERT_EQ("10", results[2]->second);
+}
+
+TEST(TEST_MAP, TestInlineStorageCopyMoveAndSerialize)
+{
+    Map<int, int, 4> small;
+    small.Insert({1, 1});
+    small.Insert({2, 2});
+
+    auto copy = small.Clone();
+    copy.InsertOrAssign(1, 10);
+    ASSERT_EQ(1, small.Find(1)->second);
+
+    Map<int, int, 4> large;
+    for (int key = 0; key < 10; ++key)
+    {
+        large.Insert({key, key});
+    }
+    large.Swap(small);
+    ASSERT_EQ(2, large.Size());
+    ASSERT_EQ(10, small.Size());
+    ASSERT_EQ(2, (--large.end())->first);
+    ASSERT_EQ(9, (--small.end())->first);
+
+    Map<int, int, 4> moved(std::move(small));
+    ASSERT_EQ(10, moved.Size());
+
+    std::stringstream stream;
+    ASSERT_TRUE(large.WriteTo(stream));
+    Map<int, int, 4> loaded;
+    ASSERT_TRUE(loaded.ReadFrom(stream));
+    ASSERT_EQ(2, loaded.Size());
+    ASSERT_EQ(2, loaded.Find(2)->second);
+}
+
 int main()
 {
     testing::InitGoogleTest();
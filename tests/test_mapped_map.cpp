@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#include "map.h"
+#include "mapped_map.h"
+
+namespace
+{
+std::string TemporaryPath(const std::string& name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+} // namespace
+
+TEST(TEST_MAPPED_MAP, TestTriviallyCopyableRoundTrip)
+{
+    Map<int, double> map;
+    for (int key = 0; key < 1000; ++key)
+    {
+        map.Insert({(key * 7919) % 1000 * 2, key * 0.5});
+    }
+    const auto path = TemporaryPath("test_mapped_map_trivial.bin");
+    ASSERT_TRUE((MappedMap<int, double>::Write(map, path)));
+
+    auto mapped = MappedMap<int, double>::Open(path);
+    ASSERT_TRUE(mapped.has_value());
+    ASSERT_TRUE(mapped->VerifyChecksum());
+    ASSERT_EQ(map.Size(), mapped->Size());
+
+    auto mapped_iterator = mapped->begin();
+    for (const auto& [key, value] : map)
+    {
+        ASSERT_EQ(key, mapped_iterator->first);
+        ASSERT_EQ(value, (mapped_iterator++)->second);
+    }
+    ASSERT_EQ(mapped->end(), mapped_iterator);
+
+    ASSERT_EQ(map.Find(42)->second, mapped->Find(42)->second);
+    ASSERT_EQ(mapped->end(), mapped->Find(43));
+    ASSERT_EQ(44, mapped->LowerBound(43)->first);
+    ASSERT_EQ(0, mapped->LowerBound(-5)->first);
+    ASSERT_EQ(mapped->end(), mapped->LowerBound(1999));
+    std::filesystem::remove(path);
+}
+
+TEST(TEST_MAPPED_MAP, TestStringRoundTrip)
+{
+    using namespace std::string_literals;
+    Map<std::string, std::string> map;
+    map.Insert({"/usr/bin"s, "binaries"s});
+    map.Insert({"/usr"s, ""s});
+    map.Insert({"/usr/lib/a/rather/long/path/that/does/not/fit/inline"s, "library"s});
+    const auto path = TemporaryPath("test_mapped_map_string.bin");
+    ASSERT_TRUE((MappedMap<std::string, std::string>::Write(map, path)));
+
+    auto mapped = MappedMap<std::string, std::string>::Open(path);
+    ASSERT_TRUE(mapped.has_value());
+    ASSERT_TRUE(mapped->VerifyChecksum());
+    ASSERT_EQ(3, mapped->Size());
+    ASSERT_EQ("binaries", mapped->Find("/usr/bin"s)->second);
+    ASSERT_EQ("", mapped->Find("/usr"s)->second);
+    ASSERT_EQ("library", mapped->LowerBound("/usr/c"s)->second);
+    ASSERT_EQ(mapped->end(), mapped->Find("/usr/lib"s));
+    std::filesystem::remove(path);
+}
+
+TEST(TEST_MAPPED_MAP, TestEmptyMap)
+{
+    Map<int, int> map;
+    const auto path = TemporaryPath("test_mapped_map_empty.bin");
+    ASSERT_TRUE((MappedMap<int, int>::Write(map, path)));
+    auto mapped = MappedMap<int, int>::Open(path);
+    ASSERT_TRUE(mapped.has_value());
+    ASSERT_TRUE(mapped->Empty());
+    ASSERT_EQ(mapped->begin(), mapped->end());
+    ASSERT_EQ(mapped->end(), mapped->Find(1));
+    std::filesystem::remove(path);
+}
+
+TEST(TEST_MAPPED_MAP, TestRejectsMismatchedOrCorruptedFiles)
+{
+    Map<int, int> map;
+    for (int key = 0; key < 100; ++key)
+    {
+        map.Insert({key, key});
+    }
+    const auto path = TemporaryPath("test_mapped_map_corrupt.bin");
+    ASSERT_TRUE((MappedMap<int, int>::Write(map, path)));
+
+    // Different key type, different encoded size
+    ASSERT_FALSE((MappedMap<long long, int>::Open(path).has_value()));
+    ASSERT_FALSE((MappedMap<int, int>::Open(TemporaryPath("test_mapped_map_missing.bin")).has_value()));
+
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(200);
+        file.put('\x7f');
+    }
+    auto mapped = MappedMap<int, int>::Open(path);
+    ASSERT_TRUE(mapped.has_value());
+    ASSERT_FALSE(mapped->VerifyChecksum());
+
+    std::filesystem::resize_file(path, 100);
+    ASSERT_FALSE((MappedMap<int, int>::Open(path).has_value()));
+    std::filesystem::remove(path);
+}
+
+TEST(TEST_MAPPED_MAP, TestRejectsCorruptedSectionOffsets)
+{
+    Map<std::string, int> map;
+    for (int key = 0; key < 100; ++key)
+    {
+        map.Insert({"key" + std::to_string(key), key});
+    }
+    const auto path = TemporaryPath("test_mapped_map_offsets.bin");
+    // Byte offsets of the entry count, key section and value section offsets in the header
+    const std::pair<std::streamoff, std::uint64_t> corruptions[] = {
+        {24, 100'000'000}, {32, 0}, {32, 1 << 20}, {40, std::uint64_t{1} << 40}, {40, 64}};
+    for (const auto& [position, value] : corruptions)
+    {
+        ASSERT_TRUE((MappedMap<std::string, int>::Write(map, path)));
+        {
+            std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(position);
+            file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+        ASSERT_FALSE((MappedMap<std::string, int>::Open(path).has_value())) << position << ' ' << value;
+    }
+
+    // Huge entry count together with a value section far past the end of the file
+    ASSERT_TRUE((MappedMap<std::string, int>::Write(map, path)));
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        const std::uint64_t entry_count = 100'000'000;
+        const std::uint64_t values_offset = std::uint64_t{1} << 40;
+        file.seekp(24);
+        file.write(reinterpret_cast<const char*>(&entry_count), sizeof(entry_count));
+        file.seekp(40);
+        file.write(reinterpret_cast<const char*>(&values_offset), sizeof(values_offset));
+    }
+    ASSERT_FALSE((MappedMap<std::string, int>::Open(path).has_value()));
+    std::filesystem::remove(path);
+}
+
+TEST(TEST_MAPPED_MAP, TestCorruptedElementOffsetsStayInBounds)
+{
+    Map<std::string, int> map;
+    for (int key = 0; key < 100; ++key)
+    {
+        map.Insert({"key" + std::to_string(key), key});
+    }
+    const auto path = TemporaryPath("test_mapped_map_element_offsets.bin");
+    ASSERT_TRUE((MappedMap<std::string, int>::Write(map, path)));
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        std::uint64_t keys_offset = 0;
+        file.seekg(32);
+        file.read(reinterpret_cast<char*>(&keys_offset), sizeof(keys_offset));
+        // One offset far past the section, one going backwards
+        const std::pair<std::uint64_t, std::uint64_t> corruptions[] = {{10, std::uint64_t{1} << 40}, {50, 1}};
+        for (const auto& [index, value] : corruptions)
+        {
+            file.seekp(static_cast<std::streamoff>(keys_offset + index * sizeof(std::uint64_t)));
+            file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+    }
+
+    // Only the header and the section bounds are checked on Open, the entries read as empty keys instead
+    auto mapped = MappedMap<std::string, int>::Open(path);
+    ASSERT_TRUE(mapped.has_value());
+    ASSERT_FALSE(mapped->VerifyChecksum());
+    std::size_t empty_keys = 0;
+    for (const auto& [key, value] : *mapped)
+    {
+        empty_keys += key.empty() ? 1 : 0;
+    }
+    ASSERT_GT(empty_keys, 0);
+    for (const auto& [key, value] : map)
+    {
+        mapped->Find(key);
+    }
+    std::filesystem::remove(path);
+}
+
+int main()
+{
+    testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
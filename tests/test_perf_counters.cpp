@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <sstream>
+
+#include "map.h"
+#include "perf_counters.h"
+
+TEST(TEST_PERF_COUNTERS, TestOperationsAreCountedOnce)
+{
+    PerfProfiler& profiler = PerfProfiler::ThisThread();
+    profiler.Reset();
+
+    // Map operations call the tree's instrumented operations, only the outermost one is recorded
+    Map<int, int, 4> map;
+    for (int key = 0; key < 100; ++key)
+    {
+        map.Insert({key, key});
+    }
+    for (int key = 0; key < 50; ++key)
+    {
+        ASSERT_NE(map.end(), map.Find(key));
+    }
+    map.Erase(map.Find(0));
+    int visited = 0;
+    for (auto it = map.begin(); it != map.end(); ++it)
+    {
+        ++visited;
+    }
+
+    ASSERT_EQ(100, profiler.Stats(PerfOperation::INSERT).count);
+    ASSERT_EQ(51, profiler.Stats(PerfOperation::FIND).count);
+    ASSERT_EQ(1, profiler.Stats(PerfOperation::ERASE).count);
+    ASSERT_EQ(visited, profiler.Stats(PerfOperation::ITERATE).count);
+    for (const auto operation : {PerfOperation::INSERT, PerfOperation::FIND, PerfOperation::ERASE})
+    {
+        const auto& histogram = profiler.Stats(operation).latency_histogram;
+        ASSERT_EQ(profiler.Stats(operation).count, std::accumulate(histogram.begin(), histogram.end(), 0ULL));
+    }
+    if (!profiler.Counters().Available(PerfEvent::INSTRUCTIONS))
+    {
+        GTEST_SKIP() << "hardware counters unavailable: " << profiler.Counters().Error();
+    }
+    ASSERT_GT(profiler.Stats(PerfOperation::INSERT).totals[static_cast<std::size_t>(PerfEvent::INSTRUCTIONS)], 0);
+}
+
+TEST(TEST_PERF_COUNTERS, TestReport)
+{
+    PerfProfiler& profiler = PerfProfiler::ThisThread();
+    profiler.Reset();
+    Map<int, int> map;
+    map.Insert({1, 1});
+
+    std::ostringstream report;
+    profiler.Report(report);
+    ASSERT_NE(std::string::npos, report.str().find("insert"));
+    ASSERT_NE(std::string::npos, report.str().find("insert latency (ns)"));
+    ASSERT_EQ(std::string::npos, report.str().find("erase latency (ns)"));
+}
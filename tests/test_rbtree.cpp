@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <map>
 
 #include "rbtree.h"
 
@@ -233,8 +234,8 @@ TEST(TEST_RB_TREE, TestTreeEmplaceForwarding)
     auto [it, result] = tree.Emplace(key, CustomType());
     ASSERT_TRUE(result);
     ASSERT_EQ(it->first, key);
-    ASSERT_EQ(move_assignment_counter, 1);
-    ASSERT_EQ(move_counter, 0);
+    ASSERT_EQ(move_assignment_counter, 0);
+    ASSERT_EQ(move_counter, 1);
     ASSERT_EQ(copy_assignment_counter, 0);
     ASSERT_EQ(copy_counter, 0);
 
@@ -247,9 +248,75 @@ TEST(TEST_RB_TREE, TestTreeEmplaceForwarding)
     ASSERT_TRUE(result);
     ASSERT_EQ(move_assignment_counter, 0);
     ASSERT_EQ(move_counter, 0);
-    ASSERT_EQ(copy_assignment_counter, 1);
-    ASSERT_EQ(copy_counter, 0);
+    ASSERT_EQ(copy_assignment_counter, 0);
+    ASSERT_EQ(copy_counter, 1);
     resetCounters();
+
+    // Duplicate keys don't construct anything
+    std::tie(it, result) = tree.Emplace(key2, unmovable_instance);
+    ASSERT_FALSE(result);
+    ASSERT_EQ(copy_counter, 0);
+}
+
+TEST(TEST_RB_TREE, TestEmplaceNonDefaultConstructibleImmovableValue)
+{
+    struct Immovable
+    {
+        Immovable(int a, std::string b) : number(a), text(std::move(b))
+        {
+        }
+        Immovable(const Immovable&) = delete;
+        Immovable& operator=(const Immovable&) = delete;
+
+        int number;
+        std::string text;
+    };
+    using namespace std::string_literals;
+    RBTree<int, Immovable> tree;
+
+    auto [it, result] = tree.TryEmplace(2, 20, "two"s);
+    ASSERT_TRUE(result);
+    ASSERT_EQ(20, it->second.number);
+    std::tie(it, result) =
+        tree.Emplace(std::piecewise_construct, std::forward_as_tuple(1), std::forward_as_tuple(10, "one"));
+    ASSERT_TRUE(result);
+    ASSERT_EQ("one", it->second.text);
+    std::tie(it, result) =
+        tree.Emplace(std::piecewise_construct, std::forward_as_tuple(2), std::forward_as_tuple(0, ""));
+    ASSERT_FALSE(result);
+    ASSERT_EQ("two", it->second.text);
+
+    ASSERT_EQ(2, tree.Size());
+    tree.Erase(tree.Find(1));
+    ASSERT_EQ(2, tree.begin()->first);
+}
+
+TEST(TEST_RB_TREE, TestTryEmplaceLeavesArgumentsOnDuplicate)
+{
+    RBTree<int, std::unique_ptr<int>> tree;
+    auto value = std::make_unique<int>(1);
+    ASSERT_TRUE(tree.TryEmplace(1, std::move(value)).second);
+    ASSERT_EQ(nullptr, value);
+
+    value = std::make_unique<int>(2);
+    auto [it, result] = tree.TryEmplace(1, std::move(value));
+    ASSERT_FALSE(result);
+    ASSERT_NE(nullptr, value);
+    ASSERT_EQ(1, *it->second);
+}
+
+TEST(TEST_RB_TREE, TestInsertOrAssign)
+{
+    using namespace std::string_literals;
+    RBTree<std::string, std::string> tree;
+    auto [it, inserted] = tree.InsertOrAssign("Key"s, "first"s);
+    ASSERT_TRUE(inserted);
+    ASSERT_EQ("first", it->second);
+
+    std::tie(it, inserted) = tree.InsertOrAssign("Key"s, "second"s);
+    ASSERT_FALSE(inserted);
+    ASSERT_EQ("second", it->second);
+    ASSERT_EQ(1, tree.Size());
 }
 
 TEST(TEST_RB_TREE, TestTreeEraseWithoutCheckingInternalRBTProperties)
@@ -307,6 +374,526 @@ TEST(TEST_RB_TREE, TestIterationAfterErase)
     }
 }
 
+TEST(TEST_RB_TREE, TestLowerBound)
+{
+    RBTree<int, int> tree;
+    for (auto key : {10, 20, 30, 40})
+    {
+        tree.Insert({key, key});
+    }
+    ASSERT_EQ(10, tree.LowerBound(5)->first);
+    ASSERT_EQ(10, tree.LowerBound(10)->first);
+    ASSERT_EQ(30, tree.LowerBound(21)->first);
+    ASSERT_EQ(40, tree.LowerBound(40)->first);
+    ASSERT_EQ(tree.end(), tree.LowerBound(41));
+}
+
+TEST(TEST_RB_TREE, TestScanVisitsHalfOpenRange)
+{
+    RBTree<int, int> tree;
+    for (int key = 0; key < 100; key += 2)
+    {
+        tree.Insert({key, key * 10});
+    }
+
+    std::vector<int> visited;
+    auto count = tree.Scan(11, 31, [&](const auto& element) {
+        ASSERT_EQ(element.first * 10, element.second);
+        visited.push_back(element.first);
+    });
+    ASSERT_EQ(10, count);
+    ASSERT_EQ((std::vector<int>{12, 14, 16, 18, 20, 22, 24, 26, 28, 30}), visited);
+
+    // Ranges reaching past the largest key stop at end()
+    ASSERT_EQ(5, tree.Scan(90, 1000, [](const auto&) {}));
+    // Empty and inverted ranges visit nothing
+    ASSERT_EQ(0, tree.Scan(20, 20, [](const auto&) {}));
+    ASSERT_EQ(0, tree.Scan(30, 20, [](const auto&) {}));
+    ASSERT_EQ(0, tree.Scan(200, 300, [](const auto&) {}));
+}
+
+TEST(TEST_RB_TREE, TestRangeCursorFill)
+{
+    RBTree<int, int> tree;
+    for (int key = 0; key < 1000; ++key)
+    {
+        tree.Insert({(key * 7919) % 1000, key});
+    }
+
+    std::array<std::pair<int, int>, 64> buffer{};
+    auto cursor = tree.Range(100, 300);
+    int expected_key = 100;
+    std::size_t filled;
+    while ((filled = cursor.Fill(buffer)) != 0)
+    {
+        for (std::size_t i = 0; i < filled; ++i)
+        {
+            ASSERT_EQ(expected_key++, buffer[i].first);
+        }
+    }
+    ASSERT_EQ(300, expected_key);
+    ASSERT_TRUE(cursor.Done());
+}
+
+TEST(TEST_RB_TREE, TestRangeCursorAgainstStdMap)
+{
+    // Deep enough that the cursor keeps only some of the pending ancestors and has to climb back to the others
+    RBTree<int, int> tree;
+    std::map<int, int> reference;
+    for (int i = 0; i < 5000; ++i)
+    {
+        const int key = (i * 7919) % 10007;
+        tree.Insert({key, i});
+        reference.insert({key, i});
+    }
+
+    for (int lo = -10; lo < 10100; lo += 997)
+    {
+        for (const int length : {0, 1, 50, 3000, 20000})
+        {
+            auto cursor = tree.Range(lo, lo + length);
+            for (auto it = reference.lower_bound(lo); it != reference.end() && it->first < lo + length; ++it)
+            {
+                ASSERT_FALSE(cursor.Done());
+                ASSERT_EQ(it->first, cursor->first);
+                ASSERT_EQ(it->second, cursor->second);
+                ++cursor;
+            }
+            ASSERT_TRUE(cursor.Done());
+        }
+    }
+}
+
+TEST(TEST_RB_TREE, TestEraseAgainstStdMap)
+{
+    RBTree<int, int> tree;
+    std::map<int, int> reference;
+    for (int i = 0; i < 2000; ++i)
+    {
+        const int key = (i * 7919) % 503;
+        if (i % 3 == 2)
+        {
+            auto it = tree.Find(key);
+            ASSERT_EQ(reference.count(key) == 1, it != tree.end());
+            if (it != tree.end())
+            {
+                auto next = tree.Erase(it);
+                auto reference_next = reference.erase(reference.find(key));
+                ASSERT_EQ(reference_next == reference.end(), next == tree.end());
+                if (next != tree.end())
+                {
+                    ASSERT_EQ(reference_next->first, next->first);
+                }
+            }
+        }
+        else
+        {
+            tree.Insert({key, i});
+            reference.insert({key, i});
+        }
+        ASSERT_EQ(reference.size(), tree.Size());
+    }
+
+    auto tree_iterator = tree.begin();
+    for (const auto& [key, value] : reference)
+    {
+        ASSERT_EQ(key, tree_iterator->first);
+        ASSERT_EQ(value, (tree_iterator++)->second);
+    }
+    ASSERT_EQ(tree.end(), tree_iterator);
+
+    while (tree.Size() != 0)
+    {
+        tree.Erase(tree.begin());
+    }
+    ASSERT_EQ(tree.begin(), tree.end());
+}
+
+TEST(TEST_RB_TREE, TestFind)
+{
+    RBTree<std::string, int> tree;
+    using namespace std::string_literals;
+    tree.Insert({"Key1"s, 1});
+    tree.Insert({"Key2"s, 2});
+    tree.Insert({"Key3"s, 3});
+
+    ASSERT_EQ(2, tree.Find("Key2"s)->second);
+    ASSERT_EQ(tree.end(), tree.Find("Key0"s));
+    ASSERT_EQ(tree.end(), tree.Find("Key4"s));
+}
+
+TEST(TEST_RB_TREE, TestFindMany)
+{
+    RBTree<int, int> tree;
+    static constexpr int kTreeSize = 10000;
+    for (int i = 0; i < kTreeSize; ++i)
+    {
+        // Even keys only, inserted in ascending order to exercise rebalancing
+        tree.Insert({2 * i, i});
+    }
+
+    std::vector<int> keys;
+    for (int i = 0; i < 3 * kTreeSize; i += 3)
+    {
+        keys.push_back(i);
+    }
+    keys.push_back(-1);
+    std::vector<RBTree<int, int>::iterator> results(keys.size());
+    tree.FindMany(keys, results);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        ASSERT_EQ(tree.Find(keys[i]), results[i]);
+        if (keys[i] >= 0 && keys[i] % 2 == 0 && keys[i] < 2 * kTreeSize)
+        {
+            ASSERT_EQ(keys[i] / 2, results[i]->second);
+        }
+        else
+        {
+            ASSERT_EQ(tree.end(), results[i]);
+        }
+    }
+
+    // Fewer keys than descents in flight, and no keys at all
+    tree.FindMany<4>(std::span(keys).first(3), results);
+    ASSERT_EQ(0, results[0]->first);
+    tree.FindMany(std::span<const int>(), std::span<RBTree<int, int>::iterator>());
+}
+
+TEST(TEST_RB_TREE, TestAssignSorted)
+{
+    for (int count : {0, 1, 2, 3, 7, 8, 100, 1000})
+    {
+        RBTree<int, int> tree;
+        tree.Insert({-1, -1});
+        int next_key = 0;
+        ASSERT_TRUE(tree.AssignSorted(count, [&]() -> std::optional<std::pair<int, int>> {
+            const int key = next_key++;
+            return std::pair{2 * key, key};
+        }));
+        ASSERT_EQ(count, tree.Size());
+        ASSERT_EQ(tree.end(), tree.Find(-1));
+
+        int expected = 0;
+        for (const auto& [key, value] : tree)
+        {
+            ASSERT_EQ(2 * expected, key);
+            ASSERT_EQ(expected++, value);
+        }
+        ASSERT_EQ(count, expected);
+
+        // The built tree stays usable for ordinary updates
+        for (int key = 1; key < 2 * count; key += 2)
+        {
+            tree.Insert({key, key});
+        }
+        for (int key = 0; key < 2 * count; key += 4)
+        {
+            tree.Erase(tree.Find(key));
+        }
+        expected = 0;
+        for (auto it = tree.begin(); it != tree.end(); ++it, ++expected)
+        {
+            while (expected % 4 == 0)
+            {
+                ++expected;
+            }
+            ASSERT_EQ(expected, it->first);
+        }
+    }
+}
+
+TEST(TEST_RB_TREE, TestAssignSortedRejectsBadInput)
+{
+    RBTree<int, int> tree;
+    const std::vector<int> unsorted{1, 2, 2, 3};
+    std::size_t i = 0;
+    ASSERT_FALSE(tree.AssignSorted(unsorted.size(), [&]() -> std::optional<std::pair<int, int>> {
+        return std::pair{unsorted[i++], 0};
+    }));
+    ASSERT_EQ(0, tree.Size());
+    ASSERT_EQ(tree.begin(), tree.end());
+
+    ASSERT_FALSE(tree.AssignSorted(3, []() -> std::optional<std::pair<int, int>> { return std::nullopt; }));
+    ASSERT_EQ(0, tree.Size());
+}
+
+TEST(TEST_RB_TREE, TestMoveAndSwap)
+{
+    RBTree<int, std::string> tree;
+    for (int key = 0; key < 100; ++key)
+    {
+        tree.Insert({key, std::to_string(key)});
+    }
+    auto it_50 = tree.Find(50);
+
+    RBTree<int, std::string> moved(std::move(tree));
+    ASSERT_EQ(0, tree.Size());
+    ASSERT_EQ(tree.begin(), tree.end());
+    ASSERT_EQ(100, moved.Size());
+    ASSERT_EQ(it_50, moved.Find(50));
+
+    // The root's parent has to be the new sentinel for erasing the root and iterating to end() to work
+    for (int key = 0; key < 100; key += 2)
+    {
+        moved.Erase(moved.Find(key));
+    }
+    ASSERT_EQ(99, (--moved.end())->first);
+
+    RBTree<int, std::string> other;
+    other.Insert({-1, "-1"});
+    other.Swap(moved);
+    ASSERT_EQ(1, moved.Size());
+    ASSERT_EQ(-1, moved.begin()->first);
+    ASSERT_EQ(50, other.Size());
+    ASSERT_EQ(1, other.begin()->first);
+
+    moved = std::move(other);
+    ASSERT_EQ(50, moved.Size());
+    ASSERT_EQ(0, other.Size());
+    int expected = 1;
+    for (const auto& [key, value] : moved)
+    {
+        ASSERT_EQ(expected, key);
+        ASSERT_EQ(std::to_string(expected), value);
+        expected += 2;
+    }
+
+    // Moved-from trees remain usable
+    other.Insert({7, "7"});
+    ASSERT_EQ(7, other.begin()->first);
+}
+
+TEST(TEST_RB_TREE, TestCopyAndClone)
+{
+    RBTree<int, int> tree;
+    for (int key = 0; key < 1000; ++key)
+    {
+        tree.Insert({(key * 7919) % 1000, key});
+    }
+
+    auto clone = tree.Clone();
+    ASSERT_EQ(tree.Size(), clone.Size());
+    auto clone_iterator = clone.begin();
+    for (const auto& [key, value] : tree)
+    {
+        ASSERT_EQ(key, clone_iterator->first);
+        ASSERT_EQ(value, (clone_iterator++)->second);
+    }
+    ASSERT_EQ(clone.end(), clone_iterator);
+
+    // The copy is independent of the original
+    clone.Find(5)->second = -1;
+    clone.Erase(clone.Find(6));
+    clone.Insert({5000, 0});
+    ASSERT_NE(-1, tree.Find(5)->second);
+    ASSERT_NE(tree.end(), tree.Find(6));
+    ASSERT_EQ(tree.end(), tree.Find(5000));
+
+    RBTree<int, int> assigned;
+    assigned.Insert({-5, -5});
+    assigned = clone;
+    ASSERT_EQ(clone.Size(), assigned.Size());
+    ASSERT_EQ(0, assigned.begin()->first);
+    ASSERT_EQ(tree.end(), tree.Find(-5));
+
+    static_assert(!std::is_copy_constructible_v<RBTree<int, std::unique_ptr<int>>>);
+}
+
+TEST(TEST_RB_TREE, TestCompact)
+{
+    RBTree<int, std::string> tree;
+    std::map<int, std::string> expected;
+    auto checkContents = [&]() {
+        ASSERT_EQ(expected.size(), tree.Size());
+        auto expected_iterator = expected.begin();
+        for (const auto& [key, value] : tree)
+        {
+            ASSERT_EQ(expected_iterator->first, key);
+            ASSERT_EQ((expected_iterator++)->second, value);
+        }
+        for (const auto& [key, value] : expected)
+        {
+            ASSERT_EQ(value, tree.Find(key)->second);
+        }
+    };
+
+    tree.Compact();
+    ASSERT_EQ(tree.end(), tree.begin());
+
+    for (int key = 0; key < 2000; ++key)
+    {
+        const int scattered = (key * 7919) % 2000;
+        tree.Insert({scattered, std::to_string(scattered)});
+        expected.emplace(scattered, std::to_string(scattered));
+    }
+    for (int key = 0; key < 2000; key += 3)
+    {
+        tree.Erase(tree.Find(key));
+        expected.erase(key);
+    }
+
+    tree.Compact();
+    checkContents();
+    // Consecutive elements sit next to each other, one node apart
+    auto previous = tree.begin();
+    auto current = previous;
+    const auto stride = reinterpret_cast<const char*>(&*++current) - reinterpret_cast<const char*>(&*previous);
+    ASSERT_GT(stride, 0);
+    for (; current != tree.end(); previous = current++)
+    {
+        ASSERT_EQ(stride, reinterpret_cast<const char*>(&*current) - reinterpret_cast<const char*>(&*previous));
+    }
+
+    // Still fully mutable: erase compacted nodes, insert new ones, compact again over the mix
+    for (int key = 1; key < 2000; key += 3)
+    {
+        tree.Erase(tree.Find(key));
+        expected.erase(key);
+    }
+    for (int key = 2000; key < 2500; ++key)
+    {
+        tree.Insert({key, std::to_string(key)});
+        expected.emplace(key, std::to_string(key));
+    }
+    checkContents();
+    tree.Compact();
+    checkContents();
+
+    RBTree<int, std::string> moved(std::move(tree));
+    tree.Insert({1, "1"});
+    ASSERT_EQ(expected.size(), moved.Size());
+    ASSERT_EQ(expected.begin()->second, moved.begin()->second);
+    tree.Clear();
+    tree.Compact();
+    ASSERT_EQ(0, tree.Size());
+}
+
+TEST(TEST_RB_TREE, TestStringKeysWithSharedPrefixes)
+{
+    // Path-like keys sharing long prefixes, keys that are prefixes of other keys and bytes above 0x7f, which order as
+    // unsigned characters
+    std::vector<std::string> keys{""};
+    const std::string root = "/srv/metrics/cluster-0/";
+    for (int i = 0; i < 300; ++i)
+    {
+        std::string key = root + "host-" + std::to_string(i % 37) + "/disk-" + std::to_string(i);
+        keys.push_back(key);
+        keys.push_back(key.substr(0, key.size() - 1));
+        keys.push_back(key + "\xff" + std::to_string(i));
+        keys.push_back(key + "\x01");
+    }
+
+    RBTree<std::string, int> tree;
+    std::map<std::string, int> expected;
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        const bool inserted = tree.Insert({keys[i], static_cast<int>(i)}).second;
+        ASSERT_EQ(expected.emplace(keys[i], static_cast<int>(i)).second, inserted);
+    }
+    ASSERT_EQ(expected.size(), tree.Size());
+    auto expected_iterator = expected.begin();
+    for (const auto& [key, value] : tree)
+    {
+        ASSERT_EQ(expected_iterator->first, key);
+        ASSERT_EQ((expected_iterator++)->second, value);
+    }
+
+    std::vector<std::string> probes = keys;
+    probes.push_back(root);
+    probes.push_back(root + "host-4");
+    probes.push_back(root + "host-4/disk-999");
+    probes.push_back(root + "\x80");
+    probes.push_back("/srv/metrics/cluster-1");
+    std::vector<RBTree<std::string, int>::iterator> found(probes.size());
+    tree.FindMany(probes, found);
+    for (std::size_t i = 0; i < probes.size(); ++i)
+    {
+        const auto expected_found = expected.find(probes[i]);
+        if (expected_found == expected.end())
+        {
+            ASSERT_EQ(tree.end(), tree.Find(probes[i]));
+            ASSERT_EQ(tree.end(), found[i]);
+        }
+        else
+        {
+            ASSERT_EQ(expected_found->second, tree.Find(probes[i])->second);
+            ASSERT_EQ(expected_found->second, found[i]->second);
+        }
+        const auto expected_bound = expected.lower_bound(probes[i]);
+        const auto bound = tree.LowerBound(probes[i]);
+        if (expected_bound == expected.end())
+        {
+            ASSERT_EQ(tree.end(), bound);
+        }
+        else
+        {
+            ASSERT_EQ(expected_bound->first, bound->first);
+        }
+    }
+}
+
+TEST(TEST_RB_TREE, TestFingerSearch)
+{
+    RBTree<int, int> tree;
+    std::map<int, int> expected;
+    for (int key = 0; key < 1000; ++key)
+    {
+        const int scattered = (key * 7919) % 1000 * 3;
+        tree.Insert({scattered, key});
+        expected.emplace(scattered, key);
+    }
+
+    // Every finger against keys on both sides of it, including keys outside the tree's range
+    std::vector<RBTree<int, int>::iterator> fingers{tree.end()};
+    for (auto it = tree.begin(); it != tree.end(); ++it)
+    {
+        fingers.push_back(it);
+    }
+    for (const auto& finger : fingers)
+    {
+        const int center = finger == tree.end() ? 1500 : finger->first;
+        for (int key = center - 40; key <= center + 40; key += 7)
+        {
+            const auto expected_bound = expected.lower_bound(key);
+            const auto bound = tree.LowerBound(finger, key);
+            if (expected_bound == expected.end())
+            {
+                ASSERT_EQ(tree.end(), bound);
+            }
+            else
+            {
+                ASSERT_EQ(expected_bound->first, bound->first);
+            }
+            const auto found = tree.Find(finger, key);
+            if (expected.contains(key))
+            {
+                ASSERT_EQ(expected[key], found->second);
+            }
+            else
+            {
+                ASSERT_EQ(tree.end(), found);
+            }
+        }
+        ASSERT_EQ(tree.end(), tree.LowerBound(finger, 3000));
+        ASSERT_EQ(0, tree.LowerBound(finger, -1)->first);
+    }
+
+    // Merge-join of a sorted sequence against the tree, forwards then backwards
+    RBTree<int, int>::FingerCursor cursor(tree);
+    for (int key = -5; key < 3005; ++key)
+    {
+        const auto found = cursor.Find(key);
+        ASSERT_EQ(key >= 0 && key < 3000 && key % 3 == 0, found != tree.end());
+    }
+    for (int key = 3005; key > -5; key -= 2)
+    {
+        const auto bound = cursor.LowerBound(key);
+        ASSERT_EQ(key > 2997 ? tree.end() : tree.Find((key + 2) / 3 * 3), bound);
+    }
+    cursor.Reset();
+    ASSERT_EQ(3, cursor.LowerBound(2)->first);
+}
+
 int main()
 {
     testing::InitGoogleTest();
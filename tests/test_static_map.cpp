@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "static_map.h"
+
+namespace
+{
+constexpr auto kOpcodes = MakeStaticMap<int, std::string_view>({
+    {0x30, "load"},
+    {0x01, "nop"},
+    {0x42, "store"},
+    {0x10, "add"},
+    {0x11, "sub"},
+    {0x7f, "halt"},
+    {0x20, "jump"},
+});
+
+static_assert(kOpcodes.Size() == 7);
+static_assert(kOpcodes.Find(0x42)->second == "store");
+static_assert(kOpcodes.Find(0x43) == kOpcodes.end());
+static_assert(kOpcodes.LowerBound(0x12)->first == 0x20);
+static_assert(kOpcodes.begin()->first == 0x01);
+} // namespace
+
+TEST(TEST_STATIC_MAP, TestIterationInKeyOrder)
+{
+    std::vector<int> keys;
+    for (const auto& [key, name] : kOpcodes)
+    {
+        keys.push_back(key);
+    }
+    ASSERT_EQ((std::vector<int>{0x01, 0x10, 0x11, 0x20, 0x30, 0x42, 0x7f}), keys);
+
+    auto it = kOpcodes.end();
+    for (auto key = keys.rbegin(); key != keys.rend(); ++key)
+    {
+        ASSERT_EQ(*key, (--it)->first);
+    }
+    ASSERT_EQ(kOpcodes.begin(), it);
+}
+
+TEST(TEST_STATIC_MAP, TestAgainstStdMap)
+{
+    // Every shape the last level of the layout can take is covered by some size up to 40
+    auto checkSize = [](auto size_constant) {
+        constexpr std::size_t kSize = decltype(size_constant)::value;
+        std::array<std::pair<int, int>, kSize> elements;
+        for (std::size_t i = 0; i < kSize; ++i)
+        {
+            elements[i] = {static_cast<int>((i * 7919) % kSize) * 2, static_cast<int>(i)};
+        }
+        const StaticMap<int, int, kSize> map(elements);
+        const std::map<int, int> expected(elements.begin(), elements.end());
+
+        for (int key = -1; key <= 2 * static_cast<int>(kSize); ++key)
+        {
+            const auto expected_found = expected.find(key);
+            const auto found = map.Find(key);
+            ASSERT_EQ(expected_found == expected.end(), found == map.end());
+            if (found != map.end())
+            {
+                ASSERT_EQ(expected_found->second, found->second);
+            }
+            const auto expected_bound = expected.lower_bound(key);
+            const auto bound = map.LowerBound(key);
+            ASSERT_EQ(expected_bound == expected.end(), bound == map.end());
+            if (bound != map.end())
+            {
+                ASSERT_EQ(expected_bound->first, bound->first);
+            }
+        }
+        const auto sameElement = [](const auto& a, const auto& b) {
+            return a.first == b.first && a.second == b.second;
+        };
+        ASSERT_TRUE(std::equal(map.begin(), map.end(), expected.begin(), expected.end(), sameElement));
+    };
+    [&]<std::size_t... kSizes>(std::index_sequence<kSizes...>) {
+        (checkSize(std::integral_constant<std::size_t, kSizes + 1>{}), ...);
+    }(std::make_index_sequence<40>{});
+}
+
+TEST(TEST_STATIC_MAP, TestDuplicateKeysAreRejected)
+{
+    ASSERT_THROW((StaticMap<int, int, 3>({{1, 1}, {2, 2}, {1, 3}})), std::invalid_argument);
+}
@@ -0,0 +1,286 @@
+#include <gtest/gtest.h>
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "rbtree.h"
+#include "string_map.h"
+
+namespace
+{
+std::size_t allocation_count = 0;
+// Usable size of the live heap blocks, so that allocator rounding is accounted for
+std::size_t live_bytes = 0;
+
+// Paths sharing long prefixes, every directory is a key of its own as well
+std::vector<std::string> MakePaths(std::size_t count)
+{
+    std::vector<std::string> paths;
+    for (std::size_t i = 0; paths.size() < count; ++i)
+    {
+        const std::string directory = "/srv/metrics/cluster-" + std::to_string(i % 7) + "/service-" + std::to_string(i);
+        paths.push_back(directory);
+        for (const char* leaf : {"/latency_p99", "/requests_total", "/errors"})
+        {
+            paths.push_back(directory + leaf);
+        }
+    }
+    paths.resize(count);
+    std::shuffle(paths.begin(), paths.end(), std::mt19937(3));
+    return paths;
+}
+} // namespace
+
+// Counts heap allocations so that tests can check how much each entry costs
+void* operator new(std::size_t size)
+{
+    ++allocation_count;
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        live_bytes += malloc_usable_size(memory);
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+// Not inlined, GCC would otherwise see std::free called on memory from operator new and warn about the mismatch
+[[gnu::noinline]] void operator delete(void* memory) noexcept
+{
+    if (memory != nullptr)
+    {
+        live_bytes -= malloc_usable_size(memory);
+    }
+    std::free(memory);
+}
+[[gnu::noinline]] void operator delete(void* memory, std::size_t) noexcept
+{
+    operator delete(memory);
+}
+// The arena allocates arrays, which sanitizers would otherwise serve without going through operator new. Not inlined
+// either, for the same mismatch warning once malloc can be seen reaching operator delete[].
+[[gnu::noinline]] void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+[[gnu::noinline]] void operator delete[](void* memory) noexcept
+{
+    operator delete(memory);
+}
+[[gnu::noinline]] void operator delete[](void* memory, std::size_t) noexcept
+{
+    operator delete(memory);
+}
+
+TEST(TEST_STRING_MAP, TestAgainstStdMap)
+{
+    StringMap<int> map;
+    std::map<std::string, int> reference;
+    const auto paths = MakePaths(3000);
+    std::mt19937 generator(7);
+    for (int i = 0; i < 20000; ++i)
+    {
+        const std::string& key = paths[generator() % paths.size()];
+        switch (generator() % 4)
+        {
+        case 0: {
+            const auto [it, inserted] = map.Insert(key, i);
+            ASSERT_EQ(reference.insert({key, i}).second, inserted);
+            ASSERT_EQ(key, it->first);
+            break;
+        }
+        case 1:
+            map.InsertOrAssign(key, i);
+            reference.insert_or_assign(key, i);
+            break;
+        case 2: {
+            const auto it = map.Find(key);
+            ASSERT_EQ(reference.count(key) == 1, it != map.end());
+            if (it != map.end())
+            {
+                map.Erase(it);
+                reference.erase(key);
+            }
+            break;
+        }
+        default: {
+            const auto it = map.LowerBound(key);
+            const auto reference_it = reference.lower_bound(key);
+            ASSERT_EQ(reference_it == reference.end(), it == map.end());
+            if (it != map.end())
+            {
+                ASSERT_EQ(reference_it->first, it->first);
+                ASSERT_EQ(reference_it->second, it->second);
+            }
+            break;
+        }
+        }
+        ASSERT_EQ(reference.size(), map.Size());
+    }
+
+    auto check = [&reference](StringMap<int>& checked) {
+        auto reference_it = reference.begin();
+        for (const auto [key, value] : checked)
+        {
+            ASSERT_EQ(reference_it->first, key);
+            ASSERT_EQ(reference_it->second, value);
+            ++reference_it;
+        }
+        ASSERT_EQ(reference.end(), reference_it);
+    };
+    check(map);
+
+    std::vector<std::string> scanned;
+    const auto count = map.Scan("/srv/metrics/cluster-3", "/srv/metrics/cluster-4", [&](auto element) {
+        ASSERT_EQ(reference.at(std::string(element.first)), element.second);
+        scanned.emplace_back(element.first);
+    });
+    ASSERT_EQ(scanned.size(), count);
+    ASSERT_GT(count, 0);
+    ASSERT_TRUE(std::is_sorted(scanned.begin(), scanned.end()));
+    ASSERT_EQ(reference.lower_bound("/srv/metrics/cluster-3")->first, scanned.front());
+
+    // Values are handed out by reference
+    map.begin()->second = -1;
+    reference.begin()->second = -1;
+    check(map);
+
+    // Copies own their keys, the original going away must not affect them
+    auto copy = std::make_unique<StringMap<int>>(map);
+    map.Clear();
+    ASSERT_TRUE(map.Empty());
+    ASSERT_EQ(0, map.ArenaBytes());
+    check(*copy);
+    StringMap<int> moved(std::move(*copy));
+    copy.reset();
+    check(moved);
+}
+
+TEST(TEST_STRING_MAP, TestShortKeysAndEmbeddedZeros)
+{
+    StringMap<int> map;
+    const std::vector<std::string> keys{"", "a", std::string("a\0", 2), std::string("a\0b", 3), "ab",
+                                        std::string("abcd\0efghijklmn", 15), "abcdefghijkl", "abcdefghijklm", "b"};
+    for (std::size_t i = keys.size(); i-- > 0;)
+    {
+        ASSERT_TRUE(map.Insert(keys[i], static_cast<int>(i)).second);
+    }
+    std::size_t i = 0;
+    for (const auto [key, value] : map)
+    {
+        ASSERT_EQ(keys[i], key);
+        ASSERT_EQ(static_cast<int>(i), value);
+        ++i;
+    }
+    ASSERT_EQ(keys.size(), i);
+    for (const auto& key : keys)
+    {
+        ASSERT_TRUE(map.Contains(key));
+    }
+    ASSERT_FALSE(map.Contains("abc"));
+    ASSERT_FALSE(map.Contains(std::string("a\0\0", 3)));
+}
+
+TEST(TEST_STRING_MAP, TestCompactSharesPrefixesAndDropsErasedKeys)
+{
+    StringMap<int> map;
+    const auto paths = MakePaths(4000);
+    std::size_t key_bytes = 0;
+    for (const auto& path : paths)
+    {
+        map.Insert(path, static_cast<int>(path.size()));
+        key_bytes += path.size();
+    }
+    ASSERT_LT(map.ArenaBytes(), key_bytes);
+
+    for (auto it = map.begin(); it != map.end();)
+    {
+        if (it->first.ends_with("/errors"))
+        {
+            it = map.Erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    const std::size_t bytes_before = map.ArenaBytes();
+    std::map<std::string, int> expected;
+    for (const auto [key, value] : map)
+    {
+        expected.emplace(key, value);
+    }
+
+    map.Compact();
+    // Every directory is a prefix of the path following it, so only the leaves take arena space
+    std::size_t leaf_bytes = 0;
+    for (const auto& [key, value] : expected)
+    {
+        leaf_bytes += key.ends_with("/latency_p99") || key.ends_with("/requests_total") ? key.size() : 0;
+    }
+    ASSERT_EQ(leaf_bytes, map.ArenaBytes());
+    ASSERT_LT(map.ArenaBytes(), bytes_before);
+
+    auto expected_it = expected.begin();
+    for (const auto [key, value] : map)
+    {
+        ASSERT_EQ(expected_it->first, key);
+        ASSERT_EQ(expected_it->second, value);
+        ++expected_it;
+    }
+    ASSERT_EQ(expected.end(), expected_it);
+    for (const auto& [key, value] : expected)
+    {
+        ASSERT_EQ(value, map.Find(key)->second);
+    }
+    ASSERT_TRUE(map.Insert("/srv/metrics/new", 1).second);
+    ASSERT_EQ(1, map.Find("/srv/metrics/new")->second);
+}
+
+TEST(TEST_STRING_MAP, TestAllocationsPerEntry)
+{
+    constexpr std::size_t kCount = 20000;
+    const auto paths = MakePaths(kCount);
+    const auto per_entry = [](std::size_t total) { return static_cast<double>(total) / kCount; };
+
+    auto allocations_before = allocation_count;
+    auto bytes_before = live_bytes;
+    RBTree<std::string, int> string_tree;
+    for (const auto& path : paths)
+    {
+        string_tree.Insert({path, 0});
+    }
+    const double string_tree_allocations = per_entry(allocation_count - allocations_before);
+    const double string_tree_bytes = per_entry(live_bytes - bytes_before);
+
+    allocations_before = allocation_count;
+    bytes_before = live_bytes;
+    StringMap<int> map;
+    for (const auto& path : paths)
+    {
+        map.Insert(path, 0);
+    }
+    const double map_allocations = per_entry(allocation_count - allocations_before);
+    const double map_bytes = per_entry(live_bytes - bytes_before);
+
+    map.Compact();
+    const double compacted_bytes = per_entry(live_bytes - bytes_before);
+
+    std::cout << "std::string keys:    " << string_tree_allocations << " allocations, " << string_tree_bytes
+              << " bytes per entry\n"
+              << "StringMap:           " << map_allocations << " allocations, " << map_bytes << " bytes per entry\n"
+              << "StringMap compacted: " << compacted_bytes << " bytes per entry\n";
+    // A node and a string each against a node each, the key bytes come from arena blocks shared by many keys
+    ASSERT_GE(string_tree_allocations, 2.0);
+    ASSERT_LT(map_allocations, 1.01);
+    ASSERT_LT(map_bytes, string_tree_bytes);
+    // Compacted, the nodes share one block and only the keys that don't start another key take arena space
+    ASSERT_LT(compacted_bytes, string_tree_bytes * 0.75);
+}
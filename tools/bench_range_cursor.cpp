@@ -0,0 +1,90 @@
+// Times in-order scans of a tree whose nodes are scattered over the heap, walking it with plain iterators and with
+// RangeCursor, whose prefetch window is meant to hide the cache misses of the successor chain.
+//
+// Usage:
+//      bench_range_cursor [SIZE] [REPETITIONS]
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "rbtree.h"
+
+namespace
+{
+// Large enough that the element and the links of a node sit on different cache lines
+struct Payload
+{
+    std::array<std::int64_t, 16> words{};
+};
+
+using Tree = RBTree<std::int64_t, Payload>;
+
+// Inserts the keys in random order, so that neighbouring keys end up in unrelated heap blocks
+void Fill(Tree& tree, std::size_t size)
+{
+    std::vector<std::int64_t> keys(size);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(1));
+    for (const auto key : keys)
+    {
+        Payload payload;
+        payload.words.fill(key);
+        tree.Insert({key, payload});
+    }
+}
+
+template <typename Scan> double NanosecondsPerElement(std::size_t size, std::size_t repetitions, Scan&& scan)
+{
+    std::int64_t checksum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < repetitions; ++i)
+    {
+        checksum += scan();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    // Keeps the scans from being optimized away
+    if (checksum == 42)
+    {
+        std::cerr << checksum << '\n';
+    }
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) /
+           static_cast<double>(size * repetitions);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t size = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+    const std::size_t repetitions = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 5;
+    Tree tree;
+    Fill(tree, size);
+    const auto lo = std::int64_t{0};
+    const auto hi = static_cast<std::int64_t>(size);
+
+    const double iterator_ns = NanosecondsPerElement(size, repetitions, [&]() {
+        std::int64_t sum = 0;
+        for (auto it = tree.LowerBound(lo); it != tree.end() && it->first < hi; ++it)
+        {
+            sum += it->second.words[0] + it->second.words[15];
+        }
+        return sum;
+    });
+    const double cursor_ns = NanosecondsPerElement(size, repetitions, [&]() {
+        std::int64_t sum = 0;
+        tree.Scan(lo, hi, [&sum](const Tree::value_type& element) {
+            sum += element.second.words[0] + element.second.words[15];
+        });
+        return sum;
+    });
+
+    std::cout << size << " elements, " << repetitions << " repetitions\n"
+              << "iterator     " << iterator_ns << " ns/element\n"
+              << "range cursor " << cursor_ns << " ns/element\n";
+    return 0;
+}
@@ -0,0 +1,249 @@
+// Replays traces of map operations with the hardware performance counter instrumentation enabled and reports the
+// counters per operation type, see perf_counters.h.
+//
+// Usage:
+//      profile_map [--inline] [--compact-every N] TRACE...
+//      profile_map --generate COUNT [SEED] > TRACE
+//
+// --inline replays on a Map keeping up to 16 elements in its inline array, --compact-every compacts the tree after
+// every N operations. A trace holds one operation per line, blank lines and lines starting with '#' are ignored:
+//      insert KEY VALUE
+//      erase KEY
+//      find KEY
+//      scan LO HI          iterates over the elements with keys in [LO, HI)
+// Every erase is reported as one erasure, including the lookup of its key. A scan goes through Map::Scan and is
+// reported as one iteration per element visited.
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "map.h"
+#include "perf_counters.h"
+
+namespace
+{
+enum class OperationType
+{
+    INSERT,
+    ERASE,
+    FIND,
+    SCAN
+};
+
+struct Operation
+{
+    OperationType type;
+    std::int64_t key;
+    std::int64_t argument; // Value of an insert, end of a scan
+};
+
+struct Options
+{
+    bool inline_storage = false;
+    std::size_t compact_every = 0;
+    std::vector<std::string> traces;
+};
+
+std::optional<Operation> ParseLine(const std::string& line)
+{
+    std::istringstream in(line);
+    std::string name;
+    Operation operation{};
+    if (!(in >> name >> operation.key))
+    {
+        return std::nullopt;
+    }
+    if (name == "insert" || name == "scan")
+    {
+        operation.type = name == "insert" ? OperationType::INSERT : OperationType::SCAN;
+        if (!(in >> operation.argument))
+        {
+            return std::nullopt;
+        }
+    }
+    else if (name == "erase" || name == "find")
+    {
+        operation.type = name == "erase" ? OperationType::ERASE : OperationType::FIND;
+    }
+    else
+    {
+        return std::nullopt;
+    }
+    std::string rest;
+    if (in >> rest)
+    {
+        return std::nullopt;
+    }
+    return operation;
+}
+
+bool ReadTrace(const std::string& path, std::vector<Operation>& operations)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "profile_map: cannot open " << path << '\n';
+        return false;
+    }
+    std::string line;
+    for (std::size_t line_number = 1; std::getline(in, line); ++line_number)
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        const auto operation = ParseLine(line);
+        if (!operation)
+        {
+            std::cerr << "profile_map: " << path << ':' << line_number << ": malformed operation \"" << line << "\"\n";
+            return false;
+        }
+        operations.push_back(*operation);
+    }
+    return true;
+}
+
+// Random mix of operations over keys in [0, count): half insertions, a third of lookups, the rest erasures and short
+// scans
+void Generate(std::size_t count, std::uint64_t seed)
+{
+    std::mt19937_64 generator(seed);
+    std::uniform_int_distribution<std::int64_t> keys(0, static_cast<std::int64_t>(count));
+    std::uniform_int_distribution<int> kinds(0, 99);
+    std::cout << "# profile_map --generate " << count << ' ' << seed << '\n';
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const int kind = kinds(generator);
+        const std::int64_t key = keys(generator);
+        if (kind < 50)
+        {
+            std::cout << "insert " << key << ' ' << static_cast<std::int64_t>(i) << '\n';
+        }
+        else if (kind < 85)
+        {
+            std::cout << "find " << key << '\n';
+        }
+        else if (kind < 95)
+        {
+            std::cout << "erase " << key << '\n';
+        }
+        else
+        {
+            std::cout << "scan " << key << ' ' << key + 100 << '\n';
+        }
+    }
+}
+
+template <class MapType> std::int64_t Replay(const std::vector<Operation>& operations, std::size_t compact_every)
+{
+    MapType map;
+    // Folds in every value read so that the lookups can't be optimized away
+    std::int64_t checksum = 0;
+    for (std::size_t i = 0; i < operations.size(); ++i)
+    {
+        const Operation& operation = operations[i];
+        switch (operation.type)
+        {
+        case OperationType::INSERT:
+            map.Insert({operation.key, operation.argument});
+            break;
+        case OperationType::ERASE: {
+            // The lookup is part of the erasure, the outer scope makes the nested Find record nothing
+            MAP_PERF_SCOPE(ERASE);
+            const auto element = map.Find(operation.key);
+            if (element != map.end())
+            {
+                map.Erase(element);
+            }
+            break;
+        }
+        case OperationType::FIND: {
+            const auto element = map.Find(operation.key);
+            checksum += element != map.end() ? element->second : 0;
+            break;
+        }
+        case OperationType::SCAN:
+            map.Scan(operation.key, operation.argument, [&](const auto& element) { checksum += element.second; });
+            break;
+        }
+        if (compact_every != 0 && (i + 1) % compact_every == 0)
+        {
+            map.Compact();
+        }
+    }
+    return checksum;
+}
+
+std::optional<Options> ParseOptions(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        if (argument == "--inline")
+        {
+            options.inline_storage = true;
+        }
+        else if (argument == "--compact-every" && i + 1 < argc)
+        {
+            options.compact_every = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (!argument.empty() && argument[0] == '-')
+        {
+            return std::nullopt;
+        }
+        else
+        {
+            options.traces.push_back(argument);
+        }
+    }
+    if (options.traces.empty())
+    {
+        return std::nullopt;
+    }
+    return options;
+}
+
+void PrintUsage()
+{
+    std::cerr << "usage: profile_map [--inline] [--compact-every N] TRACE...\n"
+                 "       profile_map --generate COUNT [SEED] > TRACE\n";
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc >= 3 && std::string(argv[1]) == "--generate")
+    {
+        Generate(std::strtoull(argv[2], nullptr, 10), argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1);
+        return 0;
+    }
+    const auto options = ParseOptions(argc, argv);
+    if (!options)
+    {
+        PrintUsage();
+        return 1;
+    }
+    std::vector<Operation> operations;
+    for (const auto& trace : options->traces)
+    {
+        if (!ReadTrace(trace, operations))
+        {
+            return 1;
+        }
+    }
+
+    PerfProfiler::ThisThread().Reset();
+    const std::int64_t checksum = options->inline_storage
+                                      ? Replay<Map<std::int64_t, std::int64_t, 16>>(operations, options->compact_every)
+                                      : Replay<Map<std::int64_t, std::int64_t>>(operations, options->compact_every);
+    std::cout << operations.size() << " operations replayed, checksum " << checksum << "\n\n";
+    PerfProfiler::ThisThread().Report(std::cout);
+    return 0;
+}